@@ -3,16 +3,27 @@
 # CMP0054 (don't dereference quoted variables in if() args)
 cmake_minimum_required(VERSION 3.1)
 
+# Build as C++20 (needed for coroutine tasks, gecom/Coroutine.hpp)
+option(GECOM_CXX20 "Compile as C++20 (enables coroutine tasks)" OFF)
+
 # Set GECOM default compile options (warnings etc.)
 function(gecom_add_default_compile_options)
+	if(GECOM_CXX20)
+		set(GECOM_GCC_STD -std=c++2a)
+	else()
+		set(GECOM_GCC_STD -std=c++1y)
+	endif()
 	if("${CMAKE_CXX_COMPILER_ID}" STREQUAL "MSVC")
 		# Full normal warnings, multithreaded build
 		add_compile_options(/W4 /MP)
+		if(GECOM_CXX20)
+			add_compile_options(/std:c++latest)
+		endif()
 		# Disable C4800: forcing X to bool (performance warning)
 		add_compile_options(/wd4800)
 	elseif("${CMAKE_CXX_COMPILER_ID}" STREQUAL "GNU")
-		# C++14, full normal warnings
-		add_compile_options(-std=c++1y -Wall -Wextra -pedantic)
+		# C++14 (or C++20), full normal warnings
+		add_compile_options(${GECOM_GCC_STD} -Wall -Wextra -pedantic)
 		# Threading support
 		add_compile_options(-pthread)
 		# Promote missing return to error
@@ -24,8 +35,8 @@ function(gecom_add_default_compile_options)
 			add_compile_options(-fdiagnostics-color)
 		endif()
 	elseif("${CMAKE_CXX_COMPILER_ID}" MATCHES "^(Apple)?Clang$")
-		# C++14, full normal warnings
-		add_compile_options(-std=c++1y -Wall -Wextra -pedantic)
+		# C++14 (or C++20), full normal warnings
+		add_compile_options(${GECOM_GCC_STD} -Wall -Wextra -pedantic)
 		# Threading support
 		add_compile_options(-pthread)
 		# Promote missing return to error
@@ -0,0 +1,649 @@
+
+#include "Platform.hpp"
+
+#ifdef GECOM_PLATFORM_WIN32
+#include <windows.h>
+#endif
+
+#ifdef GECOM_PLATFORM_POSIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define GECOM_HAVE_IO_URING
+#endif
+#endif
+#endif
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <system_error>
+#include <thread>
+
+#include "AsyncIO.hpp"
+#include "Log.hpp"
+
+using namespace std;
+using namespace gecom;
+
+namespace gecom {
+
+	namespace async {
+
+		namespace {
+
+			// largest transfer issued at once; longer requests are split
+			constexpr size_t max_transfer = size_t(1) << 30;
+
+			exception_ptr ioError(int error, const char *what) {
+#ifdef GECOM_PLATFORM_WIN32
+				return make_exception_ptr(system_error(error, system_category(), what));
+#else
+				return make_exception_ptr(system_error(error, generic_category(), what));
+#endif
+			}
+
+			// an outstanding read or write. the buffer must stay valid until it finishes.
+			class IORequest : private Uncopyable {
+			public:
+				file::native_handle_type handle;
+				bool write;
+				char *buf;
+				uint64_t offset;
+				size_t size;
+				size_t done = 0;
+
+				IORequest(file::native_handle_type handle_, bool write_, void *buf_, uint64_t offset_, size_t size_) :
+					handle(handle_), write(write_), buf(static_cast<char *>(buf_)), offset(offset_), size(size_)
+				{ }
+
+				// length of the next transfer
+				size_t length() const {
+					return min(size - done, max_transfer);
+				}
+
+				// account for a completed transfer (negative: error code).
+				// returns true if the request is finished, false if more remains to transfer.
+				bool advance(ptrdiff_t result, int &error) {
+					if (result < 0) {
+						error = int(-result);
+						return true;
+					}
+					done += size_t(result);
+					// a zero-length transfer is end of file
+					return result == 0 || done == size;
+				}
+
+				// called once when the request is finished; error is 0 on success
+				virtual void finish(int error) noexcept = 0;
+
+				virtual ~IORequest() { }
+			};
+
+			// request completing into a future for the byte count
+			class CountRequest : public IORequest {
+			private:
+				promise<size_t> m_promise;
+
+			public:
+				template <typename ...ArgTR>
+				CountRequest(promise<size_t> p, ArgTR &&...args) : IORequest(forward<ArgTR>(args)...), m_promise(move(p)) { }
+
+				virtual void finish(int error) noexcept override {
+					if (error) {
+						m_promise.set_exception(ioError(error, write ? "async write" : "async read"));
+					} else {
+						m_promise.set_value(done);
+					}
+				}
+			};
+
+			// whole-file read or write, owning the file and buffer
+			class FileRequest : public IORequest {
+			private:
+				file m_file;
+				vector<char> m_data;
+				promise<vector<char>> m_read;
+				promise<void> m_write;
+
+			public:
+				FileRequest(file f, vector<char> data, promise<vector<char>> p) :
+					IORequest(f.native_handle(), false, data.data(), 0, data.size()),
+					m_file(move(f)), m_data(move(data)), m_read(move(p))
+				{ }
+
+				FileRequest(file f, vector<char> data, promise<void> p) :
+					IORequest(f.native_handle(), true, data.data(), 0, data.size()),
+					m_file(move(f)), m_data(move(data)), m_write(move(p))
+				{ }
+
+				virtual void finish(int error) noexcept override {
+					m_file.close();
+					if (write) {
+						if (error) {
+							m_write.set_exception(ioError(error, "async file write"));
+						} else {
+							m_write.set_value();
+						}
+					} else {
+						if (error) {
+							m_read.set_exception(ioError(error, "async file read"));
+						} else {
+							// the file may have shrunk since it was sized
+							m_data.resize(done);
+							m_read.set_value(move(m_data));
+						}
+					}
+				}
+			};
+
+			void finish(IORequest *r, int error) noexcept {
+				r->finish(error);
+				delete r;
+			}
+
+			// blocking transfer of the next part of a request; returns bytes transferred or negative error
+			ptrdiff_t transfer(IORequest &r) {
+				char *p = r.buf + r.done;
+				const uint64_t offset = r.offset + r.done;
+				const size_t len = r.length();
+#ifdef GECOM_PLATFORM_WIN32
+				OVERLAPPED ov { };
+				ov.Offset = DWORD(offset);
+				ov.OffsetHigh = DWORD(offset >> 32);
+				DWORD count = 0;
+				const HANDLE h = reinterpret_cast<HANDLE>(r.handle);
+				const BOOL ok = r.write ? WriteFile(h, p, DWORD(len), &count, &ov) : ReadFile(h, p, DWORD(len), &count, &ov);
+				if (!ok) {
+					const DWORD error = GetLastError();
+					return error == ERROR_HANDLE_EOF ? 0 : -ptrdiff_t(error);
+				}
+				return ptrdiff_t(count);
+#else
+				while (true) {
+					const ssize_t count = r.write ? ::pwrite(int(r.handle), p, len, off_t(offset)) : ::pread(int(r.handle), p, len, off_t(offset));
+					if (count >= 0) return count;
+					if (errno != EINTR) return -errno;
+				}
+#endif
+			}
+
+			class IOBackend : private Uncopyable {
+			public:
+				// take ownership of a request and start it
+				virtual void submit(IORequest *) = 0;
+
+				virtual const char * name() const = 0;
+
+				virtual ~IOBackend() { }
+			};
+
+			// blocking positional i/o on a few dedicated threads
+			class ThreadBackend : public IOBackend {
+			private:
+				mutex m_mutex;
+				condition_variable m_cond;
+				deque<IORequest *> m_queue;
+				bool m_exit = false;
+				vector<thread> m_threads;
+
+				void run(size_t index) {
+					setThreadName("async-io-" + to_string(index));
+					unique_lock<mutex> lock(m_mutex);
+					while (true) {
+						while (!m_exit && m_queue.empty()) {
+							m_cond.wait(lock);
+						}
+						// queued requests are finished before exiting
+						if (m_queue.empty()) return;
+						IORequest *r = m_queue.front();
+						m_queue.pop_front();
+						lock.unlock();
+						int error = 0;
+						while (!r->advance(transfer(*r), error));
+						finish(r, error);
+						lock.lock();
+					}
+				}
+
+			public:
+				explicit ThreadBackend(size_t threads) {
+					for (size_t i = 0; i < threads; i++) {
+						m_threads.emplace_back(&ThreadBackend::run, this, i);
+					}
+				}
+
+				virtual void submit(IORequest *r) override {
+					{
+						unique_lock<mutex> lock(m_mutex);
+						m_queue.push_back(r);
+					}
+					m_cond.notify_one();
+				}
+
+				virtual const char * name() const override {
+					return "threads";
+				}
+
+				virtual ~ThreadBackend() {
+					{
+						unique_lock<mutex> lock(m_mutex);
+						m_exit = true;
+					}
+					m_cond.notify_all();
+					for (auto &t : m_threads) {
+						t.join();
+					}
+				}
+			};
+
+#ifdef GECOM_HAVE_IO_URING
+			// io_uring via raw syscalls. submission is serialized by a mutex and issued immediately;
+			// one thread reaps completions and resubmits the remainder of partial transfers.
+			// requests beyond the completion queue's capacity wait in a backlog. entries the kernel
+			// refuses for now (EAGAIN, EBUSY) are retried by the completion thread; on any other
+			// submission error the ring is abandoned and outstanding requests fail.
+			class UringBackend : public IOBackend {
+			private:
+				int m_fd = -1;
+				io_uring_params m_params;
+				void *m_sq_ptr = MAP_FAILED;
+				void *m_cq_ptr = MAP_FAILED;
+				size_t m_sq_size = 0;
+				size_t m_cq_size = 0;
+				io_uring_sqe *m_sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+				size_t m_sqes_size = 0;
+				unsigned *m_sq_head, *m_sq_tail, *m_sq_mask, *m_sq_array;
+				unsigned *m_cq_head, *m_cq_tail, *m_cq_mask;
+				io_uring_cqe *m_cqes;
+				// eventfd waking the completion thread
+				int m_wake = -1;
+				// protects the submission queue and everything below
+				mutex m_mutex;
+				size_t m_inflight = 0;
+				deque<IORequest *> m_backlog;
+				// submission error that stopped the ring, or 0
+				int m_error = 0;
+				bool m_exit = false;
+				thread m_thread;
+
+				static int enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+					return int(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+				}
+
+				template <typename T>
+				static T * offsetPtr(void *base, unsigned offset) {
+					return reinterpret_cast<T *>(static_cast<char *>(base) + offset);
+				}
+
+				void wake() {
+					const uint64_t one = 1;
+					while (::write(m_wake, &one, sizeof(one)) < 0 && errno == EINTR);
+				}
+
+				// wait for completions or a wakeup; timeout in ms, or -1 for none
+				void wait(int timeout) {
+					pollfd fds[2] { { m_fd, POLLIN, 0 }, { m_wake, POLLIN, 0 } };
+					if (::poll(fds, 2, timeout) > 0 && (fds[1].revents & POLLIN)) {
+						uint64_t count;
+						while (::read(m_wake, &count, sizeof(count)) < 0 && errno == EINTR);
+					}
+				}
+
+				// submit all queued sqes; lock assumed owned. returns 0, or the error leaving some unsubmitted.
+				int submitLocked() {
+					while (true) {
+						const unsigned pending = *m_sq_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+						if (!pending) return 0;
+						if (enter(m_fd, pending, 0, 0) < 0 && errno != EINTR) return errno;
+					}
+				}
+
+				// stop using the ring after a submission error; lock assumed owned.
+				// unsubmitted and backlogged requests are added to failed. requests the kernel
+				// has accepted still complete, since reaping needs no further submission.
+				void failLocked(int error, vector<pair<IORequest *, int>> &failed) {
+					m_error = error;
+					const unsigned head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+					for (unsigned i = head; i != *m_sq_tail; i++) {
+						failed.emplace_back(reinterpret_cast<IORequest *>(m_sqes[m_sq_array[i & *m_sq_mask]].user_data), error);
+						m_inflight--;
+					}
+					// the kernel never reads the queue again, so the entries can be taken back
+					__atomic_store_n(m_sq_tail, head, __ATOMIC_RELEASE);
+					for (auto r : m_backlog) {
+						failed.emplace_back(r, error);
+					}
+					m_backlog.clear();
+				}
+
+				// queue an sqe and submit it; lock assumed owned. returns false if the ring is full.
+				bool pushLocked(uint64_t user_data, uint8_t opcode, int fd, void *addr, size_t len, uint64_t offset) {
+					const unsigned tail = *m_sq_tail;
+					if (tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE) >= m_params.sq_entries) return false;
+					const unsigned index = tail & *m_sq_mask;
+					io_uring_sqe &sqe = m_sqes[index];
+					memset(&sqe, 0, sizeof(sqe));
+					sqe.opcode = opcode;
+					sqe.fd = fd;
+					sqe.addr = reinterpret_cast<uint64_t>(addr);
+					sqe.len = unsigned(len);
+					sqe.off = offset;
+					sqe.user_data = user_data;
+					m_sq_array[index] = index;
+					__atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+					// the completion thread retries (or fails) whatever is left unsubmitted
+					if (submitLocked()) wake();
+					return true;
+				}
+
+				// start (the next part of) a request; returns false if the ring is full. lock assumed owned
+				bool tryStartLocked(IORequest *r) {
+					if (m_inflight >= m_params.cq_entries) return false;
+					const uint8_t opcode = r->write ? IORING_OP_WRITE : IORING_OP_READ;
+					if (!pushLocked(reinterpret_cast<uint64_t>(r), opcode, int(r->handle), r->buf + r->done, r->length(), r->offset + r->done)) return false;
+					m_inflight++;
+					return true;
+				}
+
+				// start (the next part of) a request, or put it in the backlog; lock assumed owned
+				void startLocked(IORequest *r) {
+					if (!tryStartLocked(r)) m_backlog.push_back(r);
+				}
+
+				void run() {
+					setThreadName("async-io");
+					vector<pair<IORequest *, int>> completed;
+					vector<pair<IORequest *, int>> finished;
+					while (true) {
+						finished.clear();
+						// retry entries left unsubmitted; a transient error only delays them
+						bool retry = false;
+						{
+							unique_lock<mutex> lock(m_mutex);
+							const int error = m_error ? 0 : submitLocked();
+							if (error == EAGAIN || error == EBUSY) {
+								retry = true;
+							} else if (error) {
+								Log::error("AsyncIO") << "io_uring_enter failed: " << strerror(error);
+								failLocked(error, finished);
+							}
+						}
+						// reap
+						completed.clear();
+						unsigned head = *m_cq_head;
+						const unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+						for (; head != tail; head++) {
+							const io_uring_cqe &cqe = m_cqes[head & *m_cq_mask];
+							completed.emplace_back(reinterpret_cast<IORequest *>(cqe.user_data), cqe.res);
+						}
+						__atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+						// continue partial transfers; finish the rest outside the lock,
+						// since continuations may submit more i/o
+						{
+							unique_lock<mutex> lock(m_mutex);
+							for (auto &c : completed) {
+								m_inflight--;
+								int error = 0;
+								if (c.first->advance(c.second, error)) {
+									finished.emplace_back(c.first, error);
+								} else if (m_error) {
+									finished.emplace_back(c.first, m_error);
+								} else {
+									startLocked(c.first);
+								}
+							}
+							// start backlogged requests in order until the ring is full again
+							while (!m_error && !m_backlog.empty() && tryStartLocked(m_backlog.front())) {
+								m_backlog.pop_front();
+							}
+						}
+						for (auto &f : finished) {
+							finish(f.first, f.second);
+						}
+						{
+							unique_lock<mutex> lock(m_mutex);
+							if (m_exit && !m_inflight && m_backlog.empty()) return;
+						}
+						// back off briefly while the kernel refuses submissions
+						if (completed.empty()) wait(retry ? 1 : -1);
+					}
+				}
+
+			public:
+				UringBackend() { }
+
+				// set up the ring; returns false if io_uring is unavailable
+				bool init(unsigned entries) {
+					memset(&m_params, 0, sizeof(m_params));
+					m_fd = int(syscall(__NR_io_uring_setup, entries, &m_params));
+					if (m_fd < 0) return false;
+					m_wake = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+					if (m_wake < 0) return false;
+					// read and write opcodes need linux 5.6; use a 5.7 feature flag to check for them
+					if (!(m_params.features & IORING_FEAT_FAST_POLL) || !(m_params.features & IORING_FEAT_NODROP)) return false;
+					m_sq_size = m_params.sq_off.array + m_params.sq_entries * sizeof(unsigned);
+					m_cq_size = m_params.cq_off.cqes + m_params.cq_entries * sizeof(io_uring_cqe);
+					if (m_params.features & IORING_FEAT_SINGLE_MMAP) m_sq_size = m_cq_size = max(m_sq_size, m_cq_size);
+					m_sq_ptr = mmap(nullptr, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+					if (m_sq_ptr == MAP_FAILED) return false;
+					if (m_params.features & IORING_FEAT_SINGLE_MMAP) {
+						m_cq_ptr = m_sq_ptr;
+					} else {
+						m_cq_ptr = mmap(nullptr, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+						if (m_cq_ptr == MAP_FAILED) return false;
+					}
+					m_sqes_size = m_params.sq_entries * sizeof(io_uring_sqe);
+					m_sqes = static_cast<io_uring_sqe *>(mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES));
+					if (m_sqes == MAP_FAILED) return false;
+					m_sq_head = offsetPtr<unsigned>(m_sq_ptr, m_params.sq_off.head);
+					m_sq_tail = offsetPtr<unsigned>(m_sq_ptr, m_params.sq_off.tail);
+					m_sq_mask = offsetPtr<unsigned>(m_sq_ptr, m_params.sq_off.ring_mask);
+					m_sq_array = offsetPtr<unsigned>(m_sq_ptr, m_params.sq_off.array);
+					m_cq_head = offsetPtr<unsigned>(m_cq_ptr, m_params.cq_off.head);
+					m_cq_tail = offsetPtr<unsigned>(m_cq_ptr, m_params.cq_off.tail);
+					m_cq_mask = offsetPtr<unsigned>(m_cq_ptr, m_params.cq_off.ring_mask);
+					m_cqes = offsetPtr<io_uring_cqe>(m_cq_ptr, m_params.cq_off.cqes);
+					m_thread = thread(&UringBackend::run, this);
+					return true;
+				}
+
+				virtual void submit(IORequest *r) override {
+					int error = 0;
+					{
+						unique_lock<mutex> lock(m_mutex);
+						error = m_error;
+						if (!error) startLocked(r);
+					}
+					// the ring has failed
+					if (error) finish(r, error);
+				}
+
+				virtual const char * name() const override {
+					return "io_uring";
+				}
+
+				virtual ~UringBackend() {
+					if (m_thread.joinable()) {
+						{
+							// the completion thread exits once outstanding requests are done
+							unique_lock<mutex> lock(m_mutex);
+							m_exit = true;
+							wake();
+						}
+						m_thread.join();
+					}
+					if (m_sqes != MAP_FAILED) munmap(m_sqes, m_sqes_size);
+					if (m_cq_ptr != MAP_FAILED && m_cq_ptr != m_sq_ptr) munmap(m_cq_ptr, m_cq_size);
+					if (m_sq_ptr != MAP_FAILED) munmap(m_sq_ptr, m_sq_size);
+					if (m_fd >= 0) ::close(m_fd);
+					if (m_wake >= 0) ::close(m_wake);
+				}
+			};
+#endif
+
+			class IOService {
+			private:
+				struct Statics {
+					unique_ptr<IOBackend> backend;
+
+					Statics() {
+						section_guard sec("AsyncIO");
+#ifdef GECOM_HAVE_IO_URING
+						// GECOM_ASYNC_IO=threads forces the fallback
+						const char *force = getenv("GECOM_ASYNC_IO");
+						if (!force || string(force) != "threads") {
+							auto uring = make_unique<UringBackend>();
+							if (uring->init(256)) {
+								backend = move(uring);
+							} else {
+								Log::warning() << "io_uring unavailable, falling back to i/o threads";
+							}
+						}
+#endif
+						if (!backend) backend = make_unique<ThreadBackend>(4);
+						Log::info() << "Async i/o initialized using " << backend->name();
+					}
+
+					~Statics() {
+						section_guard sec("AsyncIO");
+						// outstanding requests complete before this returns
+						backend.reset();
+						Log::info() << "Async i/o deinitialized";
+					}
+				};
+
+				static auto & statics() {
+					static Statics s;
+					return s;
+				}
+
+			public:
+				static void submit(IORequest *r) {
+					if (!r->size) {
+						finish(r, 0);
+						return;
+					}
+					statics().backend->submit(r);
+				}
+
+				static const char * name() {
+					return statics().backend->name();
+				}
+			};
+
+		}
+
+		bool file::open(const string &path, ios::openmode mode) {
+			close();
+			const bool in = mode & ios::in;
+			const bool out = mode & ios::out;
+			const bool trunc = (mode & ios::trunc) || (out && !in);
+#ifdef GECOM_PLATFORM_WIN32
+			const DWORD access = (in ? GENERIC_READ : 0) | (out ? GENERIC_WRITE : 0);
+			const DWORD disposition = out ? (trunc ? CREATE_ALWAYS : OPEN_ALWAYS) : OPEN_EXISTING;
+			HANDLE h = CreateFileA(path.c_str(), access, FILE_SHARE_READ, nullptr, disposition, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (h == INVALID_HANDLE_VALUE) return false;
+			m_handle = reinterpret_cast<native_handle_type>(h);
+#else
+			int flags = (in && out) ? O_RDWR : out ? O_WRONLY : O_RDONLY;
+			if (out) flags |= O_CREAT;
+			if (trunc) flags |= O_TRUNC;
+			const int fd = ::open(path.c_str(), flags | O_CLOEXEC, 0666);
+			if (fd < 0) return false;
+			m_handle = fd;
+#endif
+			return true;
+		}
+
+		void file::close() noexcept {
+			if (!is_open()) return;
+#ifdef GECOM_PLATFORM_WIN32
+			CloseHandle(reinterpret_cast<HANDLE>(m_handle));
+#else
+			::close(int(m_handle));
+#endif
+			m_handle = -1;
+		}
+
+		uint64_t file::size() const {
+#ifdef GECOM_PLATFORM_WIN32
+			LARGE_INTEGER s;
+			if (!GetFileSizeEx(reinterpret_cast<HANDLE>(m_handle), &s)) throw system_error(int(GetLastError()), system_category(), "file size");
+			return uint64_t(s.QuadPart);
+#else
+			struct stat s;
+			if (fstat(int(m_handle), &s)) throw system_error(errno, generic_category(), "file size");
+			return uint64_t(s.st_size);
+#endif
+		}
+
+		future<size_t> file::read(uint64_t offset, void *buf, size_t size) {
+			promise<size_t> p;
+			auto f = p.get_future();
+			IOService::submit(new CountRequest(move(p), m_handle, false, buf, offset, size));
+			return f;
+		}
+
+		future<size_t> file::write(uint64_t offset, const void *buf, size_t size) {
+			promise<size_t> p;
+			auto f = p.get_future();
+			IOService::submit(new CountRequest(move(p), m_handle, true, const_cast<void *>(buf), offset, size));
+			return f;
+		}
+
+		future<vector<char>> readFile(const string &path) {
+			file f;
+			if (!f.open(path, ios::in)) {
+#ifdef GECOM_PLATFORM_WIN32
+				return make_exceptional_future<vector<char>>(ioError(int(GetLastError()), "open"));
+#else
+				return make_exceptional_future<vector<char>>(ioError(errno, "open"));
+#endif
+			}
+			vector<char> data;
+			try {
+				data.resize(f.size());
+			} catch (...) {
+				return make_exceptional_future<vector<char>>(current_exception());
+			}
+			promise<vector<char>> p;
+			auto r = p.get_future();
+			IOService::submit(new FileRequest(move(f), move(data), move(p)));
+			return r;
+		}
+
+		future<void> writeFile(const string &path, vector<char> data) {
+			file f;
+			if (!f.open(path, ios::out | ios::trunc)) {
+#ifdef GECOM_PLATFORM_WIN32
+				return make_exceptional_future<void>(ioError(int(GetLastError()), "open"));
+#else
+				return make_exceptional_future<void>(ioError(errno, "open"));
+#endif
+			}
+			promise<void> p;
+			auto r = p.get_future();
+			IOService::submit(new FileRequest(move(f), move(data), move(p)));
+			return r;
+		}
+
+		const char * ioBackend() {
+			return IOService::name();
+		}
+
+	}
+
+}
@@ -0,0 +1,103 @@
+/*
+ * GECom Async File I/O Header
+ *
+ * File reads and writes that complete into async::future without occupying
+ * a background worker. On Linux, requests are submitted to an io_uring and
+ * reaped by a single completion thread, so many reads can be in flight at
+ * once; elsewhere (or if io_uring is unavailable) a small pool of I/O threads
+ * performs positional reads and writes. Continuations attached to the
+ * returned futures are submitted to the task engine as usual.
+ */
+
+#ifndef GECOM_ASYNCIO_HPP
+#define GECOM_ASYNCIO_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ios>
+
+#include "Uncopyable.hpp"
+#include "Future.hpp"
+
+namespace gecom {
+
+	namespace async {
+
+		// file opened for asynchronous positional reads and writes.
+		// the file must stay open until all its operations have completed.
+		class file : private Uncopyable {
+		public:
+			// fd on posix, HANDLE on windows
+			using native_handle_type = std::intptr_t;
+
+		private:
+			native_handle_type m_handle = -1;
+
+		public:
+			file() { }
+
+			// open a file. modes follow std::filebuf: out alone creates or truncates,
+			// in | out opens for update (creating the file if needed).
+			explicit file(const std::string &path, std::ios::openmode mode = std::ios::in) {
+				open(path, mode);
+			}
+
+			file(file &&other) noexcept : m_handle(other.m_handle) {
+				other.m_handle = -1;
+			}
+
+			file & operator=(file &&other) noexcept {
+				if (this != &other) {
+					close();
+					m_handle = other.m_handle;
+					other.m_handle = -1;
+				}
+				return *this;
+			}
+
+			bool is_open() const noexcept {
+				return m_handle != -1;
+			}
+
+			native_handle_type native_handle() const noexcept {
+				return m_handle;
+			}
+
+			// returns false if the file could not be opened
+			bool open(const std::string &path, std::ios::openmode mode = std::ios::in);
+
+			void close() noexcept;
+
+			// current size of the file in bytes
+			uint64_t size() const;
+
+			// read up to size bytes at offset into buf, which must stay valid until the future is ready.
+			// the value is the number of bytes read, which is less than size only at end of file.
+			// errors are stored in the future as std::system_error.
+			future<size_t> read(uint64_t offset, void *buf, size_t size);
+
+			// write size bytes from buf at offset; buf must stay valid until the future is ready.
+			// the value is the number of bytes written.
+			future<size_t> write(uint64_t offset, const void *buf, size_t size);
+
+			~file() {
+				close();
+			}
+		};
+
+		// read a whole file. the future holds std::system_error if the file can't be opened or read.
+		future<std::vector<char>> readFile(const std::string &path);
+
+		// replace the contents of a file
+		future<void> writeFile(const std::string &path, std::vector<char> data);
+
+		// name of the i/o backend in use ("io_uring" or "threads")
+		const char * ioBackend();
+
+	}
+
+}
+
+#endif // GECOM_ASYNCIO_HPP
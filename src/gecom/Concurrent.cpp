@@ -1,7 +1,28 @@
 
+#include "Platform.hpp"
+
+#ifdef GECOM_PLATFORM_WIN32
+#include <windows.h>
+#endif
+
+#ifdef GECOM_PLATFORM_POSIX
+#include <pthread.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+#endif
+
 #include <vector>
+#include <array>
+#include <atomic>
+#include <algorithm>
 #include <unordered_map>
 #include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <map>
+#include <string>
 
 #include "Concurrent.hpp"
 #include "Log.hpp"
@@ -18,24 +39,384 @@ namespace gecom {
 		return mid;
 	}
 
+	namespace {
+
+#ifdef __linux__
+		// read a (small) sysfs file; empty on failure
+		string readSysfs(const string &path) {
+			string r;
+			FILE *fp = fopen(path.c_str(), "r");
+			if (!fp) return r;
+			char buf[256];
+			r.assign(buf, fread(buf, 1, sizeof(buf), fp));
+			fclose(fp);
+			return r;
+		}
+
+		// parse a cpu list like "0-3,8-11"
+		vector<unsigned> parseCpuList(const string &list) {
+			vector<unsigned> cpus;
+			const char *p = list.c_str();
+			while (*p) {
+				char *end;
+				const unsigned long a = strtoul(p, &end, 10);
+				if (end == p) break;
+				unsigned long b = a;
+				p = end;
+				if (*p == '-') {
+					b = strtoul(p + 1, &end, 10);
+					p = end;
+				}
+				for (unsigned long i = a; i <= b; i++) {
+					cpus.push_back(unsigned(i));
+				}
+				if (*p == ',') p++;
+			}
+			return cpus;
+		}
+#endif
+
+		// logical cpus the calling thread may run on (initially inherited from the process,
+		// so this respects taskset and cgroup cpusets), in ascending order
+		vector<unsigned> readAllowedCpus() {
+			vector<unsigned> cpus;
+#if defined(__linux__)
+			cpu_set_t set;
+			if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+				for (unsigned cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+					if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+				}
+			}
+#elif defined(GECOM_PLATFORM_WIN32)
+			DWORD_PTR mask, sysmask;
+			if (GetProcessAffinityMask(GetCurrentProcess(), &mask, &sysmask)) {
+				for (unsigned cpu = 0; cpu < 8 * sizeof(DWORD_PTR); cpu++) {
+					if (mask & (DWORD_PTR(1) << cpu)) cpus.push_back(cpu);
+				}
+			}
+#endif
+			if (cpus.empty()) {
+				const unsigned count = max(thread::hardware_concurrency(), 1u);
+				for (unsigned cpu = 0; cpu < count; cpu++) {
+					cpus.push_back(cpu);
+				}
+			}
+			return cpus;
+		}
+
+		vector<vector<unsigned>> readCpuCores() {
+			const vector<unsigned> allowed = readAllowedCpus();
+			auto isAllowed = [&](unsigned cpu) {
+				return binary_search(allowed.begin(), allowed.end(), cpu);
+			};
+			vector<vector<unsigned>> cores;
+#if defined(__linux__)
+			// cpus sharing a package and core id are smt siblings
+			map<pair<long, long>, vector<unsigned>> bycore;
+			for (unsigned cpu : parseCpuList(readSysfs("/sys/devices/system/cpu/online"))) {
+				if (!isAllowed(cpu)) continue;
+				const string dir = "/sys/devices/system/cpu/cpu" + to_string(cpu) + "/topology/";
+				const string core = readSysfs(dir + "core_id");
+				const string package = readSysfs(dir + "physical_package_id");
+				if (core.empty()) {
+					bycore.clear();
+					break;
+				}
+				bycore[make_pair(atol(package.c_str()), atol(core.c_str()))].push_back(cpu);
+			}
+			for (auto &c : bycore) {
+				cores.push_back(move(c.second));
+			}
+			// order cores by their first logical cpu
+			sort(cores.begin(), cores.end());
+#elif defined(GECOM_PLATFORM_WIN32)
+			DWORD len = 0;
+			GetLogicalProcessorInformation(nullptr, &len);
+			vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(len / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+			if (!info.empty() && GetLogicalProcessorInformation(info.data(), &len)) {
+				for (const auto &i : info) {
+					if (i.Relationship != RelationProcessorCore) continue;
+					vector<unsigned> cpus;
+					for (unsigned cpu = 0; cpu < 8 * sizeof(ULONG_PTR); cpu++) {
+						if ((i.ProcessorMask & (ULONG_PTR(1) << cpu)) && isAllowed(cpu)) cpus.push_back(cpu);
+					}
+					if (!cpus.empty()) cores.push_back(move(cpus));
+				}
+			}
+			sort(cores.begin(), cores.end());
+#endif
+			if (cores.empty()) {
+				// no topology information; treat each logical cpu as a core
+				for (unsigned cpu : allowed) {
+					cores.push_back({ cpu });
+				}
+			}
+			return cores;
+		}
+
+	}
+
+	void setThreadName(const string &name) {
+#if defined(__linux__)
+		pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+#elif defined(GECOM_PLATFORM_MAC)
+		pthread_setname_np(name.c_str());
+#elif defined(GECOM_PLATFORM_WIN32)
+		// SetThreadDescription is only available from windows 10 1607
+		using set_description_t = HRESULT (WINAPI *)(HANDLE, PCWSTR);
+		static const auto set_description = reinterpret_cast<set_description_t>(
+			GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "SetThreadDescription")
+		);
+		if (set_description) {
+			const wstring wname(name.begin(), name.end());
+			set_description(GetCurrentThread(), wname.c_str());
+		}
+#else
+		(void) name;
+#endif
+	}
+
+	bool setThreadAffinity(const vector<unsigned> &cpus) {
+#if defined(__linux__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		if (cpus.empty()) {
+			for (const auto &core : cpuCores()) {
+				for (unsigned cpu : core) CPU_SET(cpu, &set);
+			}
+		} else {
+			for (unsigned cpu : cpus) {
+				if (cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+			}
+		}
+		return CPU_COUNT(&set) && pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(GECOM_PLATFORM_WIN32)
+		DWORD_PTR mask = 0;
+		if (cpus.empty()) {
+			DWORD_PTR sysmask;
+			if (!GetProcessAffinityMask(GetCurrentProcess(), &mask, &sysmask)) return false;
+		} else {
+			for (unsigned cpu : cpus) {
+				if (cpu < 8 * sizeof(DWORD_PTR)) mask |= DWORD_PTR(1) << cpu;
+			}
+		}
+		return mask && SetThreadAffinityMask(GetCurrentThread(), mask);
+#else
+		(void) cpus;
+		return false;
+#endif
+	}
+
+	const vector<vector<unsigned>> & cpuCores() {
+		static const vector<vector<unsigned>> cores = readCpuCores();
+		return cores;
+	}
+
 	namespace async {
 
 		namespace {
 
+			// pooled block size classes are powers of 2 from 32 to 512 bytes
+			constexpr size_t pool_min_block_log2 = 5;
+			constexpr size_t pool_class_count = 5;
+			constexpr size_t pool_max_block = size_t(1) << (pool_min_block_log2 + pool_class_count - 1);
+
+			// blocks moved between thread caches and the global pool at once
+			constexpr size_t pool_batch_size = 32;
+
+			struct pool_block {
+				pool_block *next;
+			};
+
+			// singly-linked free list
+			struct pool_list {
+				pool_block *head = nullptr;
+				size_t size = 0;
+
+				void push(pool_block *b) noexcept {
+					b->next = head;
+					head = b;
+					size++;
+				}
+
+				pool_block * pop() noexcept {
+					pool_block *b = head;
+					head = b->next;
+					size--;
+					return b;
+				}
+
+				// move up to count blocks to another list
+				void transfer(pool_list &other, size_t count) noexcept {
+					while (head && count--) {
+						other.push(pop());
+					}
+				}
+
+				void release() noexcept {
+					while (head) {
+						::operator delete(pop());
+					}
+				}
+			};
+
+			size_t poolClass(size_t size) noexcept {
+				size_t c = 0;
+				while ((size_t(1) << (pool_min_block_log2 + c)) < size) c++;
+				return c;
+			}
+
+			size_t poolBlockSize(size_t c) noexcept {
+				return size_t(1) << (pool_min_block_log2 + c);
+			}
+
+			struct PoolStatics {
+				std::mutex mutex;
+				array<pool_list, pool_class_count> free;
+
+				~PoolStatics() {
+					for (auto &l : free) {
+						l.release();
+					}
+				}
+			};
+
+			auto & poolStatics() {
+				static PoolStatics s;
+				return s;
+			}
+
+			// per-thread block cache; trivially destructible so it stays usable
+			// for the remainder of thread (and static) destruction
+			struct PoolCache {
+				array<pool_list, pool_class_count> free;
+				bool dead = false;
+			};
+
+			auto & poolCacheStorage() {
+				static thread_local PoolCache c;
+				return c;
+			}
+
+			// returns the thread's cached blocks to the global pool on thread exit
+			struct PoolCacheGuard {
+				~PoolCacheGuard() {
+					auto &c = poolCacheStorage();
+					auto &s = poolStatics();
+					unique_lock<std::mutex> lock(s.mutex);
+					for (size_t i = 0; i < pool_class_count; i++) {
+						c.free[i].transfer(s.free[i], size_t(-1));
+					}
+					c.dead = true;
+				}
+			};
+
+			auto & poolCache() {
+				auto &c = poolCacheStorage();
+				if (!c.dead) {
+					static thread_local PoolCacheGuard guard;
+				}
+				return c;
+			}
+
+			void * poolAllocate(size_t size) {
+				if (size > pool_max_block) return ::operator new(size);
+				const size_t c = poolClass(size);
+				auto &cache = poolCache();
+				if (!cache.dead) {
+					if (!cache.free[c].head) {
+						// refill from global pool
+						auto &s = poolStatics();
+						unique_lock<std::mutex> lock(s.mutex);
+						s.free[c].transfer(cache.free[c], pool_batch_size);
+					}
+					if (cache.free[c].head) return cache.free[c].pop();
+				}
+				return ::operator new(poolBlockSize(c));
+			}
+
+			void poolDeallocate(void *p, size_t size) noexcept {
+				if (!p) return;
+				if (size > pool_max_block) {
+					::operator delete(p);
+					return;
+				}
+				const size_t c = poolClass(size);
+				auto &cache = poolCache();
+				auto &s = poolStatics();
+				if (cache.dead) {
+					unique_lock<std::mutex> lock(s.mutex);
+					s.free[c].push(static_cast<pool_block *>(p));
+					return;
+				}
+				cache.free[c].push(static_cast<pool_block *>(p));
+				if (cache.free[c].size >= 2 * pool_batch_size) {
+					// return a batch to the global pool so blocks freed by consumer
+					// threads can be reused by producer threads
+					unique_lock<std::mutex> lock(s.mutex);
+					cache.free[c].transfer(s.free[c], pool_batch_size);
+				}
+			}
+
 			class Task;
-			using task_ptr = shared_ptr<Task>;
+			using task_ptr = unique_ptr<Task>;
 
 			class Worker;
-			using worker_ptr = shared_ptr<Worker>;
 
-			class Task : public enable_shared_from_this<Task> {
+			// upper bound on background worker threads per group (and so on concurrency)
+			constexpr size_t max_workers = 256;
+
+			// upper bound on worker groups
+			constexpr size_t max_groups = 16;
+
+			// task ordering: more urgent class first, then earlier deadline
+			struct task_key {
+				task_class cls;
+				clock::time_point deadline;
+
+				static task_key max() {
+					return { task_class::bulk, clock::time_point::max() };
+				}
+
+				bool operator<(const task_key &other) const {
+					return cls < other.cls || (cls == other.cls && deadline < other.deadline);
+				}
+			};
+
+			// can run on workers reserved for latency-critical work
+			bool isLatencyClass(task_class cls) {
+				return cls <= task_class::frame;
+			}
+
+			class Task : private Uncopyable {
 			private:
 				clock::time_point m_deadline;
 				detail::runnable_ptr m_runnable;
-				worker_ptr m_worker;
+				// intrusive link for affinitized inboxes
+				Task *m_next = nullptr;
+				shared_ptr<detail::cancel_state> m_cancel;
+				clock::time_point m_submitted;
+				task_class m_class;
 
 			public:
-				Task(clock::time_point deadline_, detail::runnable_ptr runnable_) : m_deadline(move(deadline_)), m_runnable(move(runnable_)) { }
+				// deadlines are clamped below time_point::max() so every task key is below task_key::max(),
+				// which the workers use as the (exclusive) bound when taking any task
+				Task(clock::time_point deadline_, detail::runnable_ptr runnable_, shared_ptr<detail::cancel_state> cancel_ = nullptr, task_class cls_ = task_class::background) :
+					m_deadline(min(deadline_, clock::time_point::max() - clock::duration(1))),
+					m_runnable(move(runnable_)), m_cancel(move(cancel_)), m_submitted(clock::now()), m_class(cls_)
+				{ }
+
+				task_key key() const {
+					return { m_class, m_deadline };
+				}
+
+				bool latency() const {
+					return isLatencyClass(m_class);
+				}
+
+				const clock::time_point & submitted() const {
+					return m_submitted;
+				}
 
 				const clock::time_point & deadline() const {
 					return m_deadline;
@@ -45,355 +426,1574 @@ namespace gecom {
 					m_runnable->run();
 				}
 
-				bool started() const {
-					return bool(m_worker);
+				const detail::cancel_state * cancelState() const noexcept {
+					return m_cancel.get();
 				}
 
-				void start(worker_ptr);
+				bool cancelled() const noexcept {
+					return m_cancel && m_cancel->cancelled.load(memory_order_acquire);
+				}
 
-				worker_ptr finish();
+				Task * next() const noexcept {
+					return m_next;
+				}
 
-				void resume();
+				void next(Task *t) noexcept {
+					m_next = t;
+				}
 
-				void suspend();
+				static void * operator new(size_t size) {
+					return poolAllocate(size);
+				}
 
-				~Task() {
-					assert(!m_worker);
+				static void operator delete(void *p, size_t size) noexcept {
+					poolDeallocate(p, size);
 				}
 			};
 
 			struct task_compare {
 				bool operator()(const task_ptr &a, const task_ptr &b) {
-					return a->deadline() > b->deadline();
+					return b->key() < a->key();
 				}
 			};
 
-			class Worker : public enable_shared_from_this<Worker> {
+			// cancellation state of the task running on this thread
+			auto & currentCancelState() {
+				static thread_local const detail::cancel_state *cs = nullptr;
+				return cs;
+			}
+
+			// telemetry sampling interval; bumping the epoch resets all counters
+			struct TelemetryStatics {
+				atomic<unsigned> epoch { 0 };
+				atomic<clock::rep> since { clock::now().time_since_epoch().count() };
+			};
+
+			auto & telemetryStatics() {
+				static TelemetryStatics s;
+				return s;
+			}
+
+			// task counters for one thread, which is the only writer.
+			// counters are plain load/store atomics so recording needs no locked instructions;
+			// snapshots may read them at any time. a reset is applied by the writer when it
+			// next records, and until then readers treat the counters as zero.
+			class TaskStats : private Uncopyable {
 			private:
-				mutex m_mutex;
-				condition_variable m_resume_cond;
-				task_ptr m_task;
-				atomic<bool> m_should_yield { true };
-				thread m_thread;
+				class histogram {
+				private:
+					array<atomic<uint64_t>, duration_histogram::bucket_count> m_buckets;
+					atomic<uint64_t> m_count, m_total, m_max;
 
-				static void run(Worker *);
+					static void add(atomic<uint64_t> &a, uint64_t x) {
+						a.store(a.load(memory_order_relaxed) + x, memory_order_relaxed);
+					}
 
-			public:
-				Worker() {
-					section_guard sec("Async");
-					Log::info() << "Worker starting...";
-					// must start thread after constructing other fields
-					m_thread = thread(run, this);
+					static size_t bucket(uint64_t ns) {
+						unsigned r = 0;
+						for (unsigned shift = 32; shift; shift >>= 1) {
+							if (ns >> shift) {
+								ns >>= shift;
+								r += shift;
+							}
+						}
+						return min<size_t>(r, duration_histogram::bucket_count - 1);
+					}
+
+				public:
+					histogram() {
+						reset();
+					}
+
+					void record(clock::duration d) {
+						const uint64_t ns = max<int64_t>(chrono::duration_cast<chrono::nanoseconds>(d).count(), 0);
+						add(m_buckets[bucket(ns)], 1);
+						add(m_count, 1);
+						add(m_total, ns);
+						if (ns > m_max.load(memory_order_relaxed)) m_max.store(ns, memory_order_relaxed);
+					}
+
+					void reset() {
+						for (auto &b : m_buckets) b.store(0, memory_order_relaxed);
+						m_count.store(0, memory_order_relaxed);
+						m_total.store(0, memory_order_relaxed);
+						m_max.store(0, memory_order_relaxed);
+					}
+
+					void read(duration_histogram &h) const {
+						for (size_t i = 0; i < duration_histogram::bucket_count; i++) {
+							h.buckets[i] = m_buckets[i].load(memory_order_relaxed);
+						}
+						h.count = m_count.load(memory_order_relaxed);
+						h.total = chrono::nanoseconds(m_total.load(memory_order_relaxed));
+						h.max = chrono::nanoseconds(m_max.load(memory_order_relaxed));
+					}
+				};
+
+				atomic<unsigned> m_epoch;
+				atomic<uint64_t> m_run, m_cancelled, m_misses, m_busy;
+				histogram m_wait, m_runtime;
+
+				static void add(atomic<uint64_t> &a, uint64_t x) {
+					a.store(a.load(memory_order_relaxed) + x, memory_order_relaxed);
 				}
 
-				void employ(task_ptr task) {
-					unique_lock<mutex> lock(m_mutex);
-					assert(!m_task);
-					m_task = move(task);
-					resume();
+				void reset() {
+					m_run.store(0, memory_order_relaxed);
+					m_cancelled.store(0, memory_order_relaxed);
+					m_misses.store(0, memory_order_relaxed);
+					m_busy.store(0, memory_order_relaxed);
+					m_wait.reset();
+					m_runtime.reset();
 				}
 
-				void resume() noexcept {
-					m_should_yield = false;
-					m_resume_cond.notify_all();
+				void update() {
+					const unsigned epoch = telemetryStatics().epoch.load(memory_order_acquire);
+					if (m_epoch.load(memory_order_relaxed) != epoch) {
+						reset();
+						m_epoch.store(epoch, memory_order_release);
+					}
 				}
 
-				void suspend() noexcept {
-					m_should_yield = true;
+			public:
+				TaskStats() : m_epoch(telemetryStatics().epoch.load()) {
+					reset();
 				}
 
-				void yield() {
-					while (m_should_yield) {
-						unique_lock<mutex> lock(m_mutex);
-						m_resume_cond.wait(lock);
-					}
+				// record a task that ran from start to finish.
+				// nested tasks (run by yield) don't add to busy time.
+				void record(const Task &task, clock::time_point start, clock::time_point finish, bool nested) {
+					update();
+					add(m_run, 1);
+					if (finish > task.deadline()) add(m_misses, 1);
+					if (!nested) add(m_busy, chrono::duration_cast<chrono::nanoseconds>(finish - start).count());
+					m_wait.record(start - task.submitted());
+					m_runtime.record(finish - start);
 				}
 
-				~Worker() {
-					section_guard sec("Async");
-					// wake up the thread so it can exit
-					m_resume_cond.notify_all();
-					m_thread.join();
-					Log::info() << "Worker terminated";
+				void recordCancelled(size_t count = 1) {
+					update();
+					add(m_cancelled, count);
+				}
+
+				// read counters; returns time spent running tasks
+				clock::duration read(scheduler_stats &stats) const {
+					stats = scheduler_stats();
+					if (m_epoch.load(memory_order_acquire) != telemetryStatics().epoch.load(memory_order_acquire)) {
+						return clock::duration::zero();
+					}
+					stats.tasks_run = m_run.load(memory_order_relaxed);
+					stats.tasks_cancelled = m_cancelled.load(memory_order_relaxed);
+					stats.deadline_misses = m_misses.load(memory_order_relaxed);
+					m_wait.read(stats.wait_time);
+					m_runtime.read(stats.run_time);
+					return chrono::nanoseconds(m_busy.load(memory_order_relaxed));
 				}
 			};
 
-			auto & currentWorker() {
-				static thread_local Worker *cw = nullptr;
-				return cw;
+			// run a task, logging any exception it throws.
+			// cancelled tasks are dropped; returns false if dropped.
+			bool runTask(const task_ptr &task) noexcept {
+				if (task->cancelled()) return false;
+				auto &cs = currentCancelState();
+				auto cs0 = cs;
+				cs = task->cancelState();
+				try {
+					task->run();
+				} catch (exception &e) {
+					Log::error().verbosity(2) << "Task exceptioned; what(): " << e.what();
+				} catch (...) {
+					Log::error().verbosity(2) << "Task exceptioned";
+				}
+				cs = cs0;
+				return true;
 			}
 
-			void Task::start(worker_ptr p) {
-				assert(!m_worker);
-				m_worker = move(p);
-				m_worker->employ(shared_from_this());
-				resume();
-			}
+			// where background workers may run
+			struct PlacementStatics {
+				mutex placement_mutex;
+				// cores dedicated to other threads
+				vector<bool> dedicated;
+				atomic<bool> pin { false };
+				// bumped whenever placement changes, so workers know to re-apply it
+				atomic<unsigned> epoch { 0 };
 
-			worker_ptr Task::finish() {
-				assert(m_worker);
-				suspend();
-				return move(m_worker);
+				PlacementStatics() : dedicated(cpuCores().size()) { }
+			};
+
+			auto & placementStatics() {
+				static PlacementStatics s;
+				return s;
 			}
 
-			void Task::resume() {
-				assert(m_worker);
-				m_worker->resume();
+			// logical worker count for deterministic mode, or 0 if disabled.
+			// set by GECOM_ASYNC_DETERMINISTIC and read once, when the task engine initializes.
+			size_t deterministicWorkers() {
+				static const size_t n = [] {
+					const char *s = getenv("GECOM_ASYNC_DETERMINISTIC");
+					return s ? min<size_t>(strtoul(s, nullptr, 10), max_workers) : 0;
+				}();
+				return n;
 			}
 
-			void Task::suspend() {
-				if (m_worker) {
-					m_worker->suspend();
+			// cpus the worker with the specified index should run on; empty means any
+			vector<unsigned> workerCpus(size_t index) {
+				auto &ps = placementStatics();
+				unique_lock<mutex> lock(ps.placement_mutex);
+				const auto &cores = cpuCores();
+				vector<size_t> free;
+				for (size_t i = 0; i < cores.size(); i++) {
+					if (!ps.dedicated[i]) free.push_back(i);
+				}
+				vector<unsigned> cpus;
+				if (ps.pin) {
+					cpus = cores[free[index % free.size()]];
+				} else if (free.size() < cores.size()) {
+					for (size_t i : free) {
+						cpus.insert(cpus.end(), cores[i].begin(), cores[i].end());
+					}
 				}
+				return cpus;
 			}
 
-			class BackgroundScheduler {
-			private:
-				struct Statics {
-					atomic<bool> should_exit { false };
-					atomic<size_t> max_active_tasks { 1 };
-					mutex pool_mutex;
-					condition_variable pool_cond;
-					vector<worker_ptr> pool;
-					size_t pool_acquire_count = 0;
-					mutex task_mutex;
-					vector<task_ptr> active_tasks;
-					util::priority_queue<task_ptr, task_compare> pending_tasks;
+			class WorkerGroup;
 
-					Statics() {
-						Log::info("Async") << "Background task scheduler initialized";
-					}
+			// background worker thread with its own priority-ordered task queue.
+			// the owning thread pops from its queue; idle workers of the same group steal from it.
+			class Worker : private Uncopyable {
+			private:
+				WorkerGroup &m_group;
+				// protects only the local task queue
+				mutex m_mutex;
+				util::priority_queue<task_ptr, task_compare> m_tasks;
+				// queue size, readable without locking so empty queues can be skipped
+				atomic<size_t> m_size { 0 };
+				// key of the task currently being run by this worker
+				task_key m_current = task_key::max();
+				bool m_running = false;
+				// placement epoch when cpu affinity was last set
+				unsigned m_placement_epoch = ~0u;
+				// set when this thread's inherited cpu affinity has been replaced
+				bool m_placed = false;
+				// set when the thread has retired; the queue refuses tasks until restarted
+				bool m_retired = true;
+				TaskStats m_stats;
+				size_t m_index;
+				thread m_thread;
 
-					~Statics() {
-						section_guard sec("Async");
-						Log::info() << "Background task scheduler deinitializing...";
-						// signal workers should exit
-						should_exit = true;
-						// release our references to all tasks; only tasks associated with a worker thread survive
-						pending_tasks.clear();
-						active_tasks.clear();
-						// wait for all acquired workers to be released as their tasks complete
-						unique_lock<mutex> lock(pool_mutex);
-						while (pool_acquire_count > 0) {
-							pool_cond.wait(lock);
-						}
-						// clear worker pool, waits for idle workers to terminate
-						pool.clear();
-						Log::info() << "Background task scheduler deinitialized";
-					}
-				};
+				static void run(Worker *);
 
-				static auto & statics() {
-					static Statics s;
-					return s;
+				// pop the top task if it is more urgent than the specified key; queue lock assumed owned.
+				// if latency_only, only realtime and frame tasks are taken.
+				bool popLocked(task_ptr &task, const task_key &before, bool latency_only) {
+					if (m_tasks.empty()) return false;
+					const Task &top = *m_tasks.top();
+					if (!(top.key() < before) || (latency_only && !top.latency())) return false;
+					task = m_tasks.pop();
+					m_size--;
+					return true;
 				}
 
-				static worker_ptr acquireWorker() {
-					//Log::info("Async") << "Worker acquire";
-					unique_lock<mutex> lock(statics().pool_mutex);
-					if (statics().pool.empty()) {
-						auto r = make_shared<Worker>();
-						statics().pool_acquire_count++;
-						return r;
-					} else {
-						auto r = statics().pool.back();
-						statics().pool.pop_back();
-						statics().pool_acquire_count++;
-						return r;
-					}
-				}
+			public:
+				Worker(WorkerGroup &group_, size_t index_) : m_group(group_), m_index(index_) { }
 
-				static void releaseWorker(worker_ptr p) {
-					//Log::info("Async") << "Worker release";
+				// start (or restart after retirement) the worker thread; pool lock assumed owned
+				void start() {
+					section_guard sec("Async");
+					Log::info() << "Worker starting...";
 					{
-						unique_lock<mutex> lock(statics().pool_mutex);
-						statics().pool.push_back(move(p));
-						statics().pool_acquire_count--;
+						unique_lock<mutex> lock(m_mutex);
+						m_retired = false;
 					}
-					statics().pool_cond.notify_all();
+					m_placement_epoch = ~0u;
+					m_placed = false;
+					// placement statics are used by the worker, so they must be constructed
+					// (and hence destroyed) before the scheduler that joins it
+					placementStatics();
+					m_thread = thread(run, this);
 				}
 
-				static void reschedule() {
-					if (shouldExit()) return;
-					// task_mutex assumed owned
-					// move currently active tasks to possibly active task set
-					util::priority_queue<task_ptr, task_compare> possibly_active_tasks(
-						std::make_move_iterator(statics().active_tasks.begin()),
-						std::make_move_iterator(statics().active_tasks.end())
-					);
-					statics().active_tasks.clear();
-					// grab more tasks from pending task queue as needed
-					while (possibly_active_tasks.size() < statics().max_active_tasks && !statics().pending_tasks.empty()) {
-						possibly_active_tasks.push(statics().pending_tasks.pop());
-					}
-					// fill active task set
-					while (statics().active_tasks.size() < statics().max_active_tasks && !possibly_active_tasks.empty()) {
-						statics().active_tasks.push_back(possibly_active_tasks.pop());
-					}
-					// throw remaining tasks back into pending task queue after suspending them
-					while (!possibly_active_tasks.empty()) {
-						possibly_active_tasks.top()->suspend();
-						statics().pending_tasks.push(possibly_active_tasks.pop());
-					}
-					// start or resume all active tasks
-					for (auto &task : statics().active_tasks) {
-						if (task->started()) {
-							task->resume();
-						} else {
-							task->start(acquireWorker());
-						}
-					}
+				// stop accepting tasks if the queue is empty; returns false if it is not
+				bool retire() {
+					unique_lock<mutex> lock(m_mutex);
+					if (!m_tasks.empty()) return false;
+					m_retired = true;
+					return true;
 				}
 
-			public:
-				static void invoke(task_ptr task) {
-					std::unique_lock<std::mutex> lock(statics().task_mutex);
-					// add task to active set (force reschedule to consider it)
-					statics().active_tasks.push_back(std::move(task));
-					// ensure highest priority tasks are running
-					reschedule();
+				// release the thread so it can exit on its own (called by the retiring thread)
+				void detach() {
+					m_thread.detach();
 				}
 
-				static void finish(task_ptr task) {
-					std::unique_lock<std::mutex> lock(statics().task_mutex);
-					// remove task from active list
-					auto it = std::find(statics().active_tasks.begin(), statics().active_tasks.end(), task);
-					if (it != statics().active_tasks.end()) statics().active_tasks.erase(it);
-					// reclaim worker
-					releaseWorker(task->finish());
-					// ensure highest priority tasks are running
-					reschedule();
+				WorkerGroup & group() const {
+					return m_group;
 				}
 
-				static bool shouldExit() {
-					return statics().should_exit;
+				size_t index() const {
+					return m_index;
 				}
 
-				static size_t concurrency() {
-					return statics().max_active_tasks;
+				const task_key & current() const {
+					return m_current;
 				}
 
-				static void concurrency(size_t x) {
-					statics().max_active_tasks = x ? x : 1;
+				// returns false, without taking the task, if this worker has retired
+				bool push(task_ptr &task) {
+					unique_lock<mutex> lock(m_mutex);
+					if (m_retired) return false;
+					m_tasks.push(move(task));
+					m_size++;
+					return true;
 				}
-			};
-			
-			void Worker::run(Worker *this_) {
-				section_guard sec("AsyncWorker");
 
-				Log::info() << "Worker started";
+				// pop the highest priority task (called by the owning thread)
+				bool pop(task_ptr &task, const task_key &before, bool latency_only) {
+					if (!m_size) return false;
+					unique_lock<mutex> lock(m_mutex);
+					return popLocked(task, before, latency_only);
+				}
 
-				// allow yield to find this worker
-				currentWorker() = this_;
+				// steal the highest priority task (called by other threads).
+				// if not blocking, gives up immediately when the queue is contended.
+				bool steal(task_ptr &task, bool block, const task_key &before, bool latency_only) {
+					if (!m_size) return false;
+					unique_lock<mutex> lock(m_mutex, defer_lock);
+					if (block) {
+						lock.lock();
+					} else if (!lock.try_lock()) {
+						return false;
+					}
+					return popLocked(task, before, latency_only);
+				}
 
-				while (true) {
-					task_ptr task;
+				const TaskStats & stats() const {
+					return m_stats;
+				}
 
-					do {
-						// check for shutdown
-						if (BackgroundScheduler::shouldExit()) {
-							Log::info() << "Worker shutdown signaled";
-							return;
-						}
-						// try grab next task
-						unique_lock<mutex> lock(this_->m_mutex);
-						swap(task, this_->m_task);
-						if (!task) {
-							// no task, block
-							this_->m_resume_cond.wait(lock);
-						}
-					} while (!task);
+				// apply the current placement policy if it has changed (called by the owning thread)
+				void place() {
+					const unsigned epoch = placementStatics().epoch.load(memory_order_acquire);
+					if (m_placement_epoch == epoch) return;
+					m_placement_epoch = epoch;
+					const auto cpus = workerCpus(m_index);
+					// with no placement policy, keep the inherited affinity (e.g. from taskset)
+					if (cpus.empty() && !m_placed) return;
+					if (setThreadAffinity(cpus)) {
+						m_placed = !cpus.empty();
+					} else {
+						Log::warning("Async") << "Failed to set cpu affinity for worker " << m_index;
+					}
+				}
 
-					try {
-						section_guard sec("Task");
-						task->run();
-					} catch (exception &e) {
-						Log::error().verbosity(2) << "Task exceptioned; what(): " << e.what();
-					} catch (...) {
-						Log::error().verbosity(2) << "Task exceptioned";
+				// run a task on this worker's thread, tracking its priority for yield()
+				void execute(const task_ptr &task) noexcept {
+					const auto current0 = m_current;
+					const bool running0 = m_running;
+					m_current = task->key();
+					m_running = true;
+					const auto start = clock::now();
+					if (runTask(task)) {
+						// yield() runs tasks inside the current one
+						m_stats.record(*task, start, clock::now(), running0);
+					} else {
+						m_stats.recordCancelled();
 					}
+					m_current = current0;
+					m_running = running0;
+				}
 
-					// cleanup after task (possibly schedule another task to this worker)
-					BackgroundScheduler::finish(move(task));
+				void join() {
+					if (m_thread.joinable()) m_thread.join();
+				}
 
+				~Worker() {
+					section_guard sec("Async");
+					join();
+					// any tasks still queued are released here
+					Log::info() << "Worker terminated";
 				}
+			};
 
+			auto & currentWorker() {
+				static thread_local Worker *cw = nullptr;
+				return cw;
 			}
 
-			class AffinitizedScheduler {
+			// a pool of background workers with its own queues and concurrency limit
+			class WorkerGroup : private Uncopyable {
 			private:
-				struct Statics {
-					mutex task_mutex;
-					unordered_map<thread::id, util::priority_queue<task_ptr, task_compare>> pending_tasks;
+				unsigned m_index;
+				string m_name;
+				atomic<bool> m_should_exit { false };
+				atomic<size_t> m_max_active_tasks { 1 };
+				// workers [0, reserved) only run realtime and frame tasks
+				atomic<size_t> m_reserved { 0 };
+				// workers [0, min) are started eagerly and never retired
+				atomic<size_t> m_min_workers { 1 };
+				// workers above the minimum retire after being idle this long
+				atomic<clock::rep> m_idle_timeout { chrono::duration_cast<clock::duration>(chrono::seconds(10)).count() };
+				// protects worker creation and retirement
+				mutex m_pool_mutex;
+				// workers are only ever appended (until shutdown) so they can be scanned without locking.
+				// only the last running worker retires, so [0, count) are always running; retired workers
+				// keep their slot and are restarted when needed.
+				array<unique_ptr<Worker>, max_workers> m_workers;
+				atomic<size_t> m_worker_count { 0 };
+				// retired threads that have not yet exited
+				atomic<size_t> m_retiring { 0 };
+				// round-robin submission target for non-worker threads
+				atomic<size_t> m_next_worker { 0 };
+				// number of queued tasks across all workers, and how many of those are latency tasks
+				atomic<size_t> m_pending_count { 0 };
+				atomic<size_t> m_pending_latency { 0 };
+				// idle workers park here until tasks are submitted
+				mutex m_park_mutex;
+				condition_variable m_park_cond;
+				atomic<size_t> m_parked_count { 0 };
+				// idle reserved workers park here until latency tasks are submitted
+				condition_variable m_reserved_cond;
+				atomic<size_t> m_parked_reserved { 0 };
+				// workers beyond the concurrency limit park here until it is raised
+				condition_variable m_excess_cond;
+
+				// workers that are started eagerly and never retired: the configured minimum,
+				// and at least one more than the reserved workers
+				size_t minimum() const {
+					const size_t r = reserved();
+					return min(max<size_t>(m_min_workers, r ? r + 1 : 0), concurrency());
+				}
 
-					Statics() {
-						Log::info("Async") << "Affinitized task scheduler initialized";
+				// start workers until there are at least the specified number (up to the concurrency limit)
+				void spawn(size_t target) {
+					// deterministic mode has no worker threads
+					if (deterministicWorkers()) return;
+					if (m_worker_count.load(memory_order_acquire) >= target) return;
+					unique_lock<mutex> lock(m_pool_mutex);
+					target = min(target, concurrency());
+					for (size_t i = m_worker_count; i < target && !shouldExit(); i++) {
+						if (!m_workers[i]) m_workers[i] = make_unique<Worker>(*this, i);
+						m_workers[i]->start();
+						m_worker_count.store(i + 1, memory_order_release);
 					}
+				}
 
-					~Statics() {
-						Log::info("Async") << "Affinitized task scheduler deinitialized";
+				// start one more worker if below the concurrency limit
+				void grow() {
+					const size_t count = m_worker_count.load(memory_order_acquire);
+					if (count < concurrency()) spawn(count + 1);
+				}
+
+				// retire a worker's thread if it is the last running worker, above the minimum,
+				// and has no queued tasks. returns true if the calling worker thread should exit.
+				bool retire(Worker *w) {
+					{
+						unique_lock<mutex> lock(m_pool_mutex);
+						const size_t count = m_worker_count;
+						if (shouldExit() || w->index() + 1 != count || w->index() < minimum()) return false;
+						if (!w->retire()) return false;
+						m_worker_count.store(count - 1, memory_order_release);
+						m_retiring++;
+						w->detach();
 					}
-				};
+					// the next worker down may now be able to retire
+					unique_lock<mutex> lock(m_park_mutex);
+					m_park_cond.notify_all();
+					m_excess_cond.notify_all();
+					return true;
+				}
 
-				static auto & statics() {
-					static Statics s;
-					return s;
+				// choose a worker to submit a task to, or null if there are none running
+				Worker * target(bool latency) {
+					const size_t count = min<size_t>(m_worker_count.load(memory_order_acquire), concurrency());
+					if (!count) {
+						grow();
+						return nullptr;
+					}
+					const size_t first = latency ? 0 : min(reserved(), count - 1);
+					return m_workers[first + m_next_worker.fetch_add(1, memory_order_relaxed) % (count - first)].get();
 				}
 
-			public:
-				static void invoke(thread::id affinity, task_ptr task) {
-					unique_lock<mutex> lock(statics().task_mutex);
-					statics().pending_tasks[affinity].push(task);
+				// wake one parked worker that can run the task, if any
+				void wake(bool latency) {
+					if (latency && m_parked_reserved) {
+						unique_lock<mutex> lock(m_park_mutex);
+						m_reserved_cond.notify_one();
+					} else if (m_parked_count) {
+						unique_lock<mutex> lock(m_park_mutex);
+						m_park_cond.notify_one();
+					}
 				}
 
-				static size_t execute(clock::duration timebudget) noexcept {
-					size_t count = 0;
-					const auto time1 = clock::now() + timebudget;
-					while (clock::now() < time1) {
-						task_ptr task;
-						{
-							// lock the mutex only long enough to grab a task
-							unique_lock<mutex> lock(statics().task_mutex);
-							auto &q = statics().pending_tasks[this_thread::get_id()];
-							// quit if no tasks
-							if (q.empty()) break;
-							task = q.pop();
-						}
-						// execute task
-						try {
-							task->run();
-							count++;
-						} catch (exception &e) {
-							Log::error().verbosity(2) << "Task exceptioned; what(): " << e.what();
-						} catch (...) {
-							Log::error().verbosity(2) << "Task exceptioned";
+				// account for a task taken from a queue
+				void taken(const task_ptr &task) {
+					m_pending_count--;
+					if (task->latency()) m_pending_latency--;
+				}
+
+				// try to take a task from any worker other than the specified one
+				bool steal(Worker *thief, task_ptr &task, const task_key &before, bool latency_only) {
+					const size_t count = m_worker_count.load(memory_order_acquire);
+					const size_t start = thief ? thief->index() + 1 : 0;
+					// first pass avoids contended queues, second pass waits on them
+					for (int block = 0; block < 2; block++) {
+						for (size_t i = 0; i < count; i++) {
+							Worker *victim = m_workers[(start + i) % count].get();
+							if (victim == thief) continue;
+							if (victim->steal(task, block, before, latency_only)) {
+								taken(task);
+								return true;
+							}
 						}
 					}
-					return count;
+					return false;
 				}
-			};
 
-		}
+				bool isReserved(const Worker *w) {
+					return w->index() < reserved();
+				}
+
+			public:
+				WorkerGroup(unsigned index_, string name_) : m_index(index_), m_name(move(name_)) { }
+
+				unsigned index() const {
+					return m_index;
+				}
+
+				const string & name() const {
+					return m_name;
+				}
+
+				bool shouldExit() const {
+					return m_should_exit;
+				}
+
+				void invoke(task_ptr task) {
+					if (shouldExit()) return;
+					const bool latency = task->latency();
+					// start another worker if queued tasks already outnumber idle workers
+					if (m_pending_count >= m_parked_count + (latency ? m_parked_reserved.load() : 0)) grow();
+					// submit to the current worker's own queue if possible, otherwise spread round-robin.
+					// reserved workers' queues only take latency tasks.
+					Worker *w = currentWorker();
+					if (w && (&w->group() != this || w->index() >= concurrency() || (!latency && isReserved(w)))) w = nullptr;
+					// count before pushing so a worker never parks while this task is in flight
+					m_pending_count++;
+					if (latency) m_pending_latency++;
+					// the chosen worker may retire before we push; choose again
+					while (!w || !w->push(task)) {
+						if (shouldExit()) return;
+						w = target(latency);
+					}
+					wake(latency);
+				}
+
+				// get the next task for a worker to run; returns false when the worker should exit,
+				// setting retired if that is because its thread has been retired
+				bool next(Worker *w, task_ptr &task, bool &retired) {
+					retired = false;
+					// when this worker ran out of tasks
+					auto idle_since = clock::time_point::max();
+					bool retire_failed = false;
+					while (true) {
+						if (shouldExit()) return false;
+						w->place();
+						if (w->index() >= concurrency()) {
+							// excess worker: retire once our queue has been stolen, or wait for the limit to be raised
+							if ((retired = retire(w))) return false;
+							unique_lock<mutex> lock(m_park_mutex);
+							if (!shouldExit() && w->index() >= concurrency()) m_excess_cond.wait_for(lock, chrono::milliseconds(50));
+							continue;
+						}
+						const bool latency_only = isReserved(w);
+						if (w->pop(task, task_key::max(), latency_only)) {
+							taken(task);
+							return true;
+						}
+						if (steal(w, task, task_key::max(), latency_only)) return true;
+						auto &pending = latency_only ? m_pending_latency : m_pending_count;
+						if (pending) {
+							// a task is being submitted; it will be visible shortly
+							this_thread::yield();
+							continue;
+						}
+						// nothing to do, park.
+						// once idle for long enough, try to retire; if that fails, wait to be woken before trying again.
+						if (idle_since == clock::time_point::max()) idle_since = clock::now();
+						const bool timed = !retire_failed && w->index() >= minimum();
+						const auto idle_until = idle_since + idleTimeout();
+						auto &parked = latency_only ? m_parked_reserved : m_parked_count;
+						auto &cond = latency_only ? m_reserved_cond : m_park_cond;
+						bool idle = false;
+						{
+							unique_lock<mutex> lock(m_park_mutex);
+							parked++;
+							while (!idle && !shouldExit() && !pending && w->index() < concurrency() && isReserved(w) == latency_only) {
+								if (!timed) {
+									cond.wait(lock);
+									break;
+								}
+								idle = cond.wait_until(lock, idle_until) == cv_status::timeout;
+							}
+							parked--;
+						}
+						retire_failed = false;
+						if (idle) {
+							if ((retired = retire(w))) return false;
+							retire_failed = true;
+						}
+					}
+				}
+
+				// run queued tasks more urgent than the current task of the specified worker
+				void yield(Worker *w) noexcept {
+					task_ptr task;
+					const bool latency_only = isReserved(w);
+					while (!shouldExit()) {
+						if (w->pop(task, w->current(), latency_only)) {
+							taken(task);
+						} else if (!steal(w, task, w->current(), latency_only)) {
+							break;
+						}
+						w->execute(task);
+						task.reset();
+					}
+				}
+
+				size_t concurrency() const {
+					if (size_t n = deterministicWorkers()) return n;
+					return m_max_active_tasks;
+				}
+
+				void concurrency(size_t x) {
+					{
+						unique_lock<mutex> lock(m_park_mutex);
+						m_max_active_tasks = min(max<size_t>(x, 1), max_workers);
+					}
+					// release any workers that are no longer in excess, and retire those that are
+					m_excess_cond.notify_all();
+					m_park_cond.notify_all();
+					m_reserved_cond.notify_all();
+					prespawn();
+				}
+
+				size_t minWorkers() const {
+					return m_min_workers;
+				}
+
+				void minWorkers(size_t x) {
+					{
+						unique_lock<mutex> lock(m_park_mutex);
+						m_min_workers = min(x, max_workers);
+					}
+					// idle workers may now be able to retire
+					m_park_cond.notify_all();
+					prespawn();
+				}
+
+				clock::duration idleTimeout() const {
+					return clock::duration(m_idle_timeout.load());
+				}
+
+				void idleTimeout(clock::duration d) {
+					{
+						unique_lock<mutex> lock(m_park_mutex);
+						m_idle_timeout = max(d, clock::duration::zero()).count();
+					}
+					m_park_cond.notify_all();
+				}
+
+				// start the minimum workers ahead of the first submission
+				void prespawn() {
+					spawn(minimum());
+				}
+
+				// reserved workers; always leaves at least one unreserved
+				size_t reserved() const {
+					return min<size_t>(m_reserved, concurrency() - 1);
+				}
+
+				void reserve(size_t x) {
+					{
+						unique_lock<mutex> lock(m_park_mutex);
+						m_reserved = min(x, max_workers);
+					}
+					// parked workers may have changed role
+					m_park_cond.notify_all();
+					m_reserved_cond.notify_all();
+					prespawn();
+				}
+
+				// called by a retired worker thread as the last thing it does
+				void exited() {
+					m_retiring--;
+				}
+
+				void telemetry(group_telemetry &gt, clock::duration interval) {
+					gt.name = m_name;
+					gt.concurrency = concurrency();
+					gt.reserved = reserved();
+					gt.parked_workers = m_parked_count + m_parked_reserved;
+					gt.pending_tasks = m_pending_count;
+					const size_t count = m_worker_count.load(memory_order_acquire);
+					gt.workers = count;
+					gt.worker.resize(count);
+					const double seconds = chrono::duration<double>(interval).count();
+					for (size_t i = 0; i < count; i++) {
+						auto &ws = gt.worker[i];
+						const auto busy = m_workers[i]->stats().read(ws.tasks);
+						ws.utilisation = seconds > 0 ? min(chrono::duration<double>(busy).count() / seconds, 1.0) : 0;
+						gt.tasks += ws.tasks;
+					}
+				}
+
+				// signal workers should exit
+				void signalExit() {
+					{
+						unique_lock<mutex> lock(m_park_mutex);
+						m_should_exit = true;
+					}
+					m_park_cond.notify_all();
+					m_reserved_cond.notify_all();
+					m_excess_cond.notify_all();
+				}
+
+				~WorkerGroup() {
+					signalExit();
+					// wait for all workers to finish their current tasks before destroying any queues;
+					// tasks still queued are released without running
+					const size_t count = m_worker_count;
+					for (size_t i = 0; i < count; i++) {
+						m_workers[i]->join();
+					}
+					// retired threads no longer touch their worker, but still report their exit
+					while (m_retiring) {
+						this_thread::yield();
+					}
+					for (auto &w : m_workers) {
+						w.reset();
+					}
+				}
+			};
+
+			// deterministic mode: background tasks of all groups are run by async::execute() on the main thread,
+			// in order of class, deadline and then submission, as if by a fixed number of logical workers.
+			// each call runs as many tasks as were queued when it started, regardless of time budget,
+			// so the same program with the same deadlines produces the same execution order every run.
+			class DeterministicScheduler {
+			private:
+				struct entry {
+					task_ptr task;
+					uint64_t seq;
+				};
+
+				struct entry_compare {
+					bool operator()(const entry &a, const entry &b) {
+						const auto ka = a.task->key();
+						const auto kb = b.task->key();
+						return kb < ka || (!(ka < kb) && b.seq < a.seq);
+					}
+				};
+
+				struct Statics {
+					mutex queue_mutex;
+					util::priority_queue<entry, entry_compare> queue;
+					uint64_t next_seq = 0;
+					// per logical worker; written only by the main thread
+					vector<unique_ptr<TaskStats>> workers;
+					uint64_t runs = 0;
+					unsigned depth = 0;
+
+					Statics() {
+						for (size_t i = 0; i < deterministicWorkers(); i++) {
+							workers.push_back(make_unique<TaskStats>());
+						}
+						Log::info("Async") << "Deterministic task scheduler initialized with " << workers.size() << " logical workers";
+					}
+				};
+
+				static auto & statics() {
+					static Statics s;
+					return s;
+				}
+
+			public:
+				static void invoke(task_ptr task) {
+					auto &s = statics();
+					unique_lock<mutex> lock(s.queue_mutex);
+					s.queue.push({ move(task), s.next_seq++ });
+				}
+
+				static size_t pending() {
+					auto &s = statics();
+					unique_lock<mutex> lock(s.queue_mutex);
+					return s.queue.size();
+				}
 
-		void detail::invoke(std::thread::id affinity, clock::time_point deadline, detail::runnable_ptr taskfun) {
+				// key of the most urgent queued task; returns false if none
+				static bool peek(task_key &key) {
+					auto &s = statics();
+					unique_lock<mutex> lock(s.queue_mutex);
+					if (s.queue.empty()) return false;
+					key = s.queue.top().task->key();
+					return true;
+				}
+
+				// run the most urgent queued task on the main thread; returns false if none
+				static bool runNext() {
+					auto &s = statics();
+					task_ptr task;
+					{
+						unique_lock<mutex> lock(s.queue_mutex);
+						if (s.queue.empty()) return false;
+						task = s.queue.pop().task;
+					}
+					auto &stats = *s.workers[s.runs++ % s.workers.size()];
+					const auto start = clock::now();
+					s.depth++;
+					const bool ran = runTask(task);
+					s.depth--;
+					if (ran) {
+						stats.record(*task, start, clock::now(), s.depth);
+					} else {
+						stats.recordCancelled();
+					}
+					return true;
+				}
+
+				static void telemetry(telemetry_snapshot &snap) {
+					auto &s = statics();
+					auto &gt = snap.groups[0];
+					gt.workers = s.workers.size();
+					gt.worker.resize(s.workers.size());
+					gt.pending_tasks = pending();
+					const double seconds = chrono::duration<double>(snap.interval).count();
+					for (size_t i = 0; i < s.workers.size(); i++) {
+						auto &ws = gt.worker[i];
+						const auto busy = s.workers[i]->read(ws.tasks);
+						ws.utilisation = seconds > 0 ? min(chrono::duration<double>(busy).count() / seconds, 1.0) : 0;
+						gt.tasks += ws.tasks;
+						snap.background += ws.tasks;
+					}
+				}
+			};
+
+			class BackgroundScheduler {
+			private:
+				struct Statics {
+					// protects group creation
+					mutex group_mutex;
+					// groups are only ever appended (until shutdown) so they can be found without locking
+					array<unique_ptr<WorkerGroup>, max_groups> groups;
+					atomic<size_t> group_count { 0 };
+
+					Statics() {
+						groups[0] = make_unique<WorkerGroup>(0, "default");
+						group_count = 1;
+						groups[0]->prespawn();
+						Log::info("Async") << "Background task scheduler initialized";
+					}
+
+					~Statics() {
+						section_guard sec("Async");
+						Log::info() << "Background task scheduler deinitializing...";
+						// a task in one group may be waiting on another; signal them all before joining any
+						const size_t count = group_count;
+						for (size_t i = 0; i < count; i++) {
+							groups[i]->signalExit();
+						}
+						for (size_t i = count; i-- > 0; ) {
+							groups[i].reset();
+						}
+						Log::info() << "Background task scheduler deinitialized";
+					}
+				};
+
+				static auto & statics() {
+					static Statics s;
+					return s;
+				}
+
+			public:
+				static WorkerGroup & group(worker_group g) {
+					auto &s = statics();
+					assert(g.index() < s.group_count.load(memory_order_acquire));
+					return *s.groups[g.index()];
+				}
+
+				static worker_group group(const string &name) {
+					auto &s = statics();
+					unique_lock<mutex> lock(s.group_mutex);
+					const size_t count = s.group_count;
+					for (size_t i = 0; i < count; i++) {
+						if (s.groups[i]->name() == name) return worker_group(unsigned(i));
+					}
+					if (count >= max_groups) throw runtime_error("too many worker groups");
+					s.groups[count] = make_unique<WorkerGroup>(unsigned(count), name);
+					s.group_count.store(count + 1, memory_order_release);
+					s.groups[count]->prespawn();
+					Log::info("Async") << "Worker group '" << name << "' created";
+					return worker_group(unsigned(count));
+				}
+
+				static void invoke(worker_group g, task_ptr task) {
+					if (deterministicWorkers()) {
+						assert(g.index() < statics().group_count.load(memory_order_acquire));
+						DeterministicScheduler::invoke(move(task));
+						return;
+					}
+					group(g).invoke(move(task));
+				}
+
+				static void telemetry(telemetry_snapshot &snap) {
+					auto &s = statics();
+					const size_t count = s.group_count.load(memory_order_acquire);
+					snap.groups.resize(count);
+					for (size_t i = 0; i < count; i++) {
+						s.groups[i]->telemetry(snap.groups[i], snap.interval);
+						snap.background += snap.groups[i].tasks;
+					}
+					if (deterministicWorkers()) DeterministicScheduler::telemetry(snap);
+					const auto &gt = snap.groups[0];
+					snap.concurrency = gt.concurrency;
+					snap.workers = gt.workers;
+					snap.parked_workers = gt.parked_workers;
+					snap.pending_tasks = gt.pending_tasks;
+					snap.worker = gt.worker;
+				}
+			};
+			
+			void Worker::run(Worker *this_) {
+				section_guard sec("AsyncWorker");
+
+				Log::info() << "Worker started";
+
+				// allow yield and invoke to find this worker
+				currentWorker() = this_;
+
+				// name for profilers and debuggers
+				WorkerGroup &group = this_->m_group;
+				setThreadName((group.name() == "default" ? string("worker") : group.name().substr(0, 10)) + "-" + to_string(this_->m_index));
+
+				bool retired = false;
+				{
+					// entered once rather than per task; entering a new section allocates
+					section_guard sec2("Task");
+					task_ptr task;
+					while (group.next(this_, task, retired)) {
+						this_->execute(task);
+						task.reset();
+					}
+				}
+
+				if (retired) {
+					// the worker may already have been restarted on another thread; don't touch it
+					Log::info() << "Worker retired";
+					group.exited();
+				} else {
+					Log::info() << "Worker shutdown signaled";
+				}
+			}
+
+			// tasks affinitized to one thread.
+			// any thread can push (lock-free); only the owning thread drains and runs.
+			class Inbox : private Uncopyable {
+			private:
+				// pushed tasks, most recent first
+				atomic<Task *> m_head { nullptr };
+				// drained tasks; owning thread only
+				util::priority_queue<task_ptr, task_compare> m_ready;
+				// execute() nesting depth; owning thread only
+				unsigned m_depth = 0;
+				TaskStats m_stats;
+				// next registered inbox; set before the inbox is published
+				Inbox *m_next = nullptr;
+
+			public:
+				Inbox() { }
+
+				Inbox * next() const {
+					return m_next;
+				}
+
+				void next(Inbox *n) {
+					m_next = n;
+				}
+
+				void push(task_ptr task) {
+					Task *t = task.release();
+					Task *h = m_head.load(memory_order_relaxed);
+					do {
+						t->next(h);
+					} while (!m_head.compare_exchange_weak(h, t, memory_order_release, memory_order_relaxed));
+				}
+
+				// move all pushed tasks to the ready queue in one batch
+				void drain() {
+					if (!m_head.load(memory_order_relaxed)) return;
+					Task *t = m_head.exchange(nullptr, memory_order_acquire);
+					while (t) {
+						Task *n = t->next();
+						t->next(nullptr);
+						m_ready.push(task_ptr(t));
+						t = n;
+					}
+				}
+
+				bool pop(task_ptr &task) {
+					if (m_ready.empty()) return false;
+					task = m_ready.pop();
+					return true;
+				}
+
+				// most urgent ready task, or null
+				const Task * peek() const {
+					return m_ready.empty() ? nullptr : m_ready.top().get();
+				}
+
+				void execute(const task_ptr &task) noexcept {
+					const auto start = clock::now();
+					m_depth++;
+					const bool ran = runTask(task);
+					m_depth--;
+					if (ran) {
+						m_stats.record(*task, start, clock::now(), m_depth);
+					} else {
+						m_stats.recordCancelled();
+					}
+				}
+
+				const TaskStats & stats() const {
+					return m_stats;
+				}
+
+				~Inbox() {
+					// tasks never executed are released without running
+					drain();
+					m_ready.clear();
+				}
+			};
+
+			class AffinitizedScheduler {
+			private:
+				struct Statics {
+					// guards registration only, not task submission
+					mutex inbox_mutex;
+					unordered_map<thread::id, unique_ptr<Inbox>> inboxes;
+					// every registered inbox, most recent first; only ever prepended,
+					// so telemetry can scan it without locking
+					atomic<Inbox *> registered { nullptr };
+
+					Statics() {
+						Log::info("Async") << "Affinitized task scheduler initialized";
+					}
+
+					~Statics() {
+						Log::info("Async") << "Affinitized task scheduler deinitialized";
+					}
+				};
+
+				static auto & statics() {
+					static Statics s;
+					return s;
+				}
+
+				// inboxes live as long as the scheduler, so pointers to them can be cached
+				static Inbox * inbox(thread::id affinity) {
+					auto &s = statics();
+					unique_lock<mutex> lock(s.inbox_mutex);
+					auto &p = s.inboxes[affinity];
+					if (!p) {
+						p = make_unique<Inbox>();
+						p->next(s.registered.load(memory_order_relaxed));
+						s.registered.store(p.get(), memory_order_release);
+					}
+					return p.get();
+				}
+
+				// deterministic mode: run the tasks posted to this thread and the background tasks
+				// queued before the call, interleaved by priority. later tasks wait for the next call.
+				static size_t step(Inbox *my_inbox) noexcept {
+					size_t background = DeterministicScheduler::pending();
+					size_t count = 0;
+					my_inbox->drain();
+					while (true) {
+						const Task *top = my_inbox->peek();
+						task_key key;
+						if (background && DeterministicScheduler::peek(key) && (!top || key < top->key())) {
+							DeterministicScheduler::runNext();
+							background--;
+						} else if (top) {
+							task_ptr task;
+							my_inbox->pop(task);
+							my_inbox->execute(task);
+						} else {
+							break;
+						}
+						count++;
+					}
+					return count;
+				}
+
+			public:
+				static void invoke(thread::id affinity, task_ptr task) {
+					// cache the last target; most posts go to the same thread (usually main)
+					thread_local thread::id last_affinity;
+					thread_local Inbox *last_inbox = nullptr;
+					if (!last_inbox || last_affinity != affinity) {
+						last_inbox = inbox(affinity);
+						last_affinity = affinity;
+					}
+					last_inbox->push(move(task));
+				}
+
+				// combined stats of all affinitized threads
+				static void telemetry(scheduler_stats &stats) {
+					auto &s = statics();
+					for (Inbox *i = s.registered.load(memory_order_acquire); i; i = i->next()) {
+						scheduler_stats x;
+						i->stats().read(x);
+						stats += x;
+					}
+				}
+
+				static size_t execute(clock::duration timebudget) noexcept {
+					thread_local Inbox *my_inbox = inbox(this_thread::get_id());
+					if (deterministicWorkers() && this_thread::get_id() == mainThreadId()) return step(my_inbox);
+					size_t count = 0;
+					const auto time1 = clock::now() + timebudget;
+					while (clock::now() < time1) {
+						// pick up tasks posted since the last one ran, so deadlines stay ordered
+						my_inbox->drain();
+						task_ptr task;
+						// quit if no tasks
+						if (!my_inbox->pop(task)) break;
+						// execute task
+						my_inbox->execute(task);
+						count++;
+					}
+					return count;
+				}
+			};
+
+			// hierarchical timer wheel with 1ms ticks.
+			// 4 levels of 256 slots cover 2^32 ticks (~49 days); anything further out
+			// is parked in the last slot and re-filed when that slot comes round.
+			// insertion is O(1); each timer is moved down at most once per level.
+			// advancing skips stretches of empty slots, so waking after a long idle costs
+			// time proportional to the occupied slots passed, not the elapsed ticks.
+			class TimerWheel : private Uncopyable {
+			public:
+				using tick_t = uint64_t;
+
+				struct timer {
+					tick_t due;
+					thread::id affinity;
+					clock::time_point deadline;
+					detail::runnable_ptr runnable;
+					timer *next = nullptr;
+
+					timer(tick_t due_, thread::id affinity_, clock::time_point deadline_, detail::runnable_ptr runnable_) :
+						due(due_), affinity(affinity_), deadline(deadline_), runnable(move(runnable_))
+					{ }
+				};
+
+				static constexpr unsigned slot_bits = 8;
+				static constexpr unsigned slot_count = 1 << slot_bits;
+				static constexpr unsigned level_count = 4;
+
+			private:
+				clock::time_point m_epoch;
+				// last processed tick
+				tick_t m_now = 0;
+				size_t m_size = 0;
+				array<array<timer *, slot_count>, level_count> m_slots;
+
+				static unsigned slotIndex(tick_t t, unsigned level) noexcept {
+					return unsigned(t >> (slot_bits * level)) & (slot_count - 1);
+				}
+
+				// file a timer in its slot; timers already due go in the slot for the earliest tick
+				void file(timer *t, tick_t earliest) noexcept {
+					const tick_t due = max(t->due, earliest);
+					const tick_t delta = due - m_now;
+					unsigned level = 0;
+					while (level + 1 < level_count && delta >= (tick_t(1) << (slot_bits * (level + 1)))) level++;
+					// beyond the top level: park in the furthest slot
+					const tick_t key = min(due, m_now + (tick_t(1) << (slot_bits * level_count)) - 1);
+					auto &head = m_slots[level][slotIndex(key, level)];
+					t->next = head;
+					head = t;
+				}
+
+				// re-file a higher-level slot as its time range comes up
+				void cascade(unsigned level, unsigned index) noexcept {
+					timer *t = exchange(m_slots[level][index], nullptr);
+					while (t) {
+						timer *n = t->next;
+						// the level 0 slot for the current tick is yet to be processed
+						file(t, m_now);
+						t = n;
+					}
+				}
+
+			public:
+				TimerWheel() : m_epoch(clock::now()) {
+					for (auto &level : m_slots) level.fill(nullptr);
+				}
+
+				// first tick at or after a time, so timers never fire early
+				tick_t tickAt(clock::time_point time) const noexcept {
+					if (time <= m_epoch) return 0;
+					return tick_t((time - m_epoch + chrono::milliseconds(1) - clock::duration(1)) / chrono::milliseconds(1));
+				}
+
+				clock::time_point timeOf(tick_t tick) const noexcept {
+					return m_epoch + tick * chrono::milliseconds(1);
+				}
+
+				// last tick at or before a time
+				tick_t tickBefore(clock::time_point time) const noexcept {
+					if (time <= m_epoch) return 0;
+					return tick_t((time - m_epoch) / chrono::milliseconds(1));
+				}
+
+				bool empty() const noexcept {
+					return !m_size;
+				}
+
+				void insert(tick_t due, thread::id affinity, clock::time_point deadline, detail::runnable_ptr runnable) {
+					file(detail::pool_new<timer>(due, affinity, deadline, move(runnable)), m_now + 1);
+					m_size++;
+				}
+
+				// advance to a tick, collecting timers that have become due (most recent first)
+				timer * advance(tick_t tick) noexcept {
+					timer *fired = nullptr;
+					while (m_now < tick) {
+						if (!m_size) {
+							m_now = tick;
+							break;
+						}
+						// if the next tick has no timers and cascades nothing, jump to the next slot that needs attention
+						const tick_t n = m_now + 1;
+						if (!m_slots[0][slotIndex(n, 0)] && (n & (slot_count - 1))) {
+							const tick_t next = nextTick();
+							if (next > tick) {
+								m_now = tick;
+								break;
+							}
+							m_now = next - 1;
+						}
+						m_now++;
+						// cascade each level whose lower levels have just wrapped
+						for (unsigned level = 1; level < level_count; level++) {
+							if (m_now & ((tick_t(1) << (slot_bits * level)) - 1)) break;
+							cascade(level, slotIndex(m_now, level));
+						}
+						timer *t = exchange(m_slots[0][slotIndex(m_now, 0)], nullptr);
+						while (t) {
+							timer *n = t->next;
+							t->next = fired;
+							fired = t;
+							m_size--;
+							t = n;
+						}
+					}
+					return fired;
+				}
+
+				// tick of the next slot that needs attention; earliest due timer is no earlier
+				tick_t nextTick() const noexcept {
+					tick_t best = numeric_limits<tick_t>::max();
+					for (unsigned level = 0; level < level_count; level++) {
+						const unsigned shift = slot_bits * level;
+						const tick_t pos = m_now >> shift;
+						for (unsigned d = 1; d <= slot_count; d++) {
+							if (m_slots[level][unsigned(pos + d) & (slot_count - 1)]) {
+								best = min(best, (pos + d) << shift);
+								break;
+							}
+						}
+					}
+					return best;
+				}
+
+				static void destroy(timer *t) noexcept {
+					while (t) {
+						timer *n = t->next;
+						detail::pool_delete(t);
+						t = n;
+					}
+				}
+
+				~TimerWheel() {
+					// timers not yet due are released without running
+					for (auto &level : m_slots) {
+						for (auto t : level) destroy(t);
+					}
+				}
+			};
+
+			// holds tasks until a due time, then submits them to their scheduler
+			class TimerScheduler {
+			private:
+				using tick_t = TimerWheel::tick_t;
+
+				struct Statics {
+					mutex timer_mutex;
+					condition_variable timer_cond;
+					TimerWheel wheel;
+					// tick the timer thread will next wake at
+					tick_t wake_tick = numeric_limits<tick_t>::max();
+					bool should_exit = false;
+					thread timer_thread;
+
+					Statics() {
+						// must start thread after constructing other fields
+						timer_thread = thread(run, this);
+						Log::info("Async") << "Timer task scheduler initialized";
+					}
+
+					~Statics() {
+						{
+							unique_lock<mutex> lock(timer_mutex);
+							should_exit = true;
+						}
+						timer_cond.notify_all();
+						timer_thread.join();
+						Log::info("Async") << "Timer task scheduler deinitialized";
+					}
+				};
+
+				static auto & statics() {
+					static Statics s;
+					return s;
+				}
+
+				static void run(Statics *s_) {
+					section_guard sec("AsyncTimer");
+					setThreadName("async-timer");
+					auto &s = *s_;
+					unique_lock<mutex> lock(s.timer_mutex);
+					while (!s.should_exit) {
+						if (TimerWheel::timer *fired = s.wheel.advance(s.wheel.tickBefore(clock::now()))) {
+							// don't hold the timer lock while submitting
+							lock.unlock();
+							for (auto t = fired; t; t = t->next) {
+								detail::invoke(t->affinity, t->deadline, move(t->runnable));
+							}
+							TimerWheel::destroy(fired);
+							lock.lock();
+							continue;
+						}
+						if (s.wheel.empty()) {
+							s.wake_tick = numeric_limits<tick_t>::max();
+							s.timer_cond.wait(lock);
+						} else {
+							s.wake_tick = s.wheel.nextTick();
+							s.timer_cond.wait_until(lock, s.wheel.timeOf(s.wake_tick));
+						}
+					}
+				}
+
+			public:
+				static void invoke(clock::time_point due, thread::id affinity, clock::time_point deadline, detail::runnable_ptr runnable) {
+					auto &s = statics();
+					bool wake;
+					{
+						unique_lock<mutex> lock(s.timer_mutex);
+						if (s.should_exit) return;
+						const tick_t tick = s.wheel.tickAt(due);
+						s.wheel.insert(tick, affinity, deadline, move(runnable));
+						wake = tick < s.wake_tick;
+						if (wake) s.wake_tick = tick;
+					}
+					// wake the timer thread if its next wakeup moved earlier
+					if (wake) s.timer_cond.notify_one();
+				}
+			};
+
+		}
+
+		void * detail::pool_allocate(size_t size) {
+			return poolAllocate(size);
+		}
+
+		void detail::pool_deallocate(void *p, size_t size) noexcept {
+			poolDeallocate(p, size);
+		}
+
+		bool detail::assist() noexcept {
+			if (!deterministicWorkers() || this_thread::get_id() != mainThreadId()) return false;
+			return DeterministicScheduler::runNext();
+		}
+
+		void detail::invoke(std::thread::id affinity, clock::time_point deadline, detail::runnable_ptr taskfun, shared_ptr<cancel_state> cancel) {
 			if (affinity == thread::id()) {
-				BackgroundScheduler::invoke(make_shared<Task>(move(deadline), move(taskfun)));
+				BackgroundScheduler::invoke(worker_group(), make_unique<Task>(move(deadline), move(taskfun), move(cancel)));
 			} else {
-				AffinitizedScheduler::invoke(affinity, make_shared<Task>(move(deadline), move(taskfun)));
+				AffinitizedScheduler::invoke(affinity, make_unique<Task>(move(deadline), move(taskfun), move(cancel)));
 			}
 		}
 
+		void detail::invoke(worker_group group, task_class cls, clock::time_point deadline, detail::runnable_ptr taskfun, shared_ptr<cancel_state> cancel) {
+			BackgroundScheduler::invoke(group, make_unique<Task>(move(deadline), move(taskfun), move(cancel), cls));
+		}
+
+		void detail::invokeAt(clock::time_point due, std::thread::id affinity, clock::time_point deadline, detail::runnable_ptr taskfun) {
+			if (due <= clock::now()) {
+				detail::invoke(move(affinity), move(deadline), move(taskfun));
+			} else {
+				TimerScheduler::invoke(due, move(affinity), move(deadline), move(taskfun));
+			}
+		}
+
+		void detail::invokePeriodic(clock::time_point due, shared_ptr<periodic_state> state) {
+			auto affinity = state->affinity;
+			detail::invokeAt(due, affinity, due, detail::make_callable_runnable([due, state = move(state)]() mutable {
+				if (state->cancelled) return;
+				if (state->enabled) {
+					// an exception shouldn't stop later runs
+					try {
+						state->fun();
+					} catch (exception &e) {
+						Log::error().verbosity(2) << "Periodic task exceptioned; what(): " << e.what();
+					} catch (...) {
+						Log::error().verbosity(2) << "Periodic task exceptioned";
+					}
+				}
+				if (state->cancelled) return;
+				// skip runs we're already a whole period late for
+				auto next = due + state->period;
+				const auto now = clock::now();
+				if (next <= now) next += ((now - next) / state->period + 1) * state->period;
+				invokePeriodic(next, move(state));
+			}));
+		}
+
+		size_t deterministic() noexcept {
+			return deterministicWorkers();
+		}
+
+		bool cancelled() noexcept {
+			auto cs = currentCancelState();
+			return cs && cs->cancelled.load(memory_order_acquire);
+		}
+
+		telemetry_snapshot telemetry() {
+			telemetry_snapshot snap;
+			snap.interval = clock::now() - clock::time_point(clock::duration(telemetryStatics().since.load()));
+			BackgroundScheduler::telemetry(snap);
+			AffinitizedScheduler::telemetry(snap.affinitized);
+			return snap;
+		}
+
+		void resetTelemetry() noexcept {
+			auto &ts = telemetryStatics();
+			ts.since = clock::now().time_since_epoch().count();
+			ts.epoch++;
+		}
+
+		worker_group group(const std::string &name) {
+			return BackgroundScheduler::group(name);
+		}
+
+		void concurrency(worker_group g, size_t x) {
+			BackgroundScheduler::group(g).concurrency(x);
+		}
+
+		size_t concurrency(worker_group g) noexcept {
+			return BackgroundScheduler::group(g).concurrency();
+		}
+
+		void reserve(worker_group g, size_t x) {
+			BackgroundScheduler::group(g).reserve(x);
+		}
+
+		size_t reserved(worker_group g) noexcept {
+			return BackgroundScheduler::group(g).reserved();
+		}
+
 		void concurrency(size_t x) {
-			BackgroundScheduler::concurrency(x);
+			concurrency(worker_group(), x);
 		}
 
 		size_t concurrency() noexcept {
-			return BackgroundScheduler::concurrency();
+			return concurrency(worker_group());
+		}
+
+		void reserve(size_t x) {
+			reserve(worker_group(), x);
+		}
+
+		size_t reserved() noexcept {
+			return reserved(worker_group());
+		}
+
+		void minWorkers(worker_group g, size_t x) {
+			BackgroundScheduler::group(g).minWorkers(x);
+		}
+
+		size_t minWorkers(worker_group g) noexcept {
+			return BackgroundScheduler::group(g).minWorkers();
+		}
+
+		void idleTimeout(worker_group g, clock::duration d) {
+			BackgroundScheduler::group(g).idleTimeout(d);
+		}
+
+		clock::duration idleTimeout(worker_group g) noexcept {
+			return BackgroundScheduler::group(g).idleTimeout();
+		}
+
+		void minWorkers(size_t x) {
+			minWorkers(worker_group(), x);
+		}
+
+		size_t minWorkers() noexcept {
+			return minWorkers(worker_group());
+		}
+
+		void idleTimeout(clock::duration d) {
+			idleTimeout(worker_group(), d);
+		}
+
+		clock::duration idleTimeout() noexcept {
+			return idleTimeout(worker_group());
+		}
+
+		void pinWorkers(bool b) {
+			auto &ps = placementStatics();
+			ps.pin = b;
+			ps.epoch++;
+		}
+
+		bool pinWorkers() noexcept {
+			return placementStatics().pin;
+		}
+
+		int dedicateCore() {
+			auto &ps = placementStatics();
+			const auto &cores = cpuCores();
+			int core = -1;
+			{
+				unique_lock<mutex> lock(ps.placement_mutex);
+				const size_t free = count(ps.dedicated.begin(), ps.dedicated.end(), false);
+				// leave at least one core for workers
+				if (free < 2) return -1;
+				core = int(find(ps.dedicated.begin(), ps.dedicated.end(), false) - ps.dedicated.begin());
+				if (!setThreadAffinity(cores[core])) return -1;
+				ps.dedicated[core] = true;
+			}
+			ps.epoch++;
+			Log::info("Async") << "Dedicated core " << core << " to thread " << this_thread::get_id();
+			return core;
 		}
 
 		void yield() noexcept {
 			if (Worker *worker = currentWorker()) {
-				worker->yield();
+				worker->group().yield(worker);
 			}
 		}
 
@@ -409,6 +2009,8 @@ namespace gecom {
 		if (refcount++ == 0) {
 			// init main thread id
 			mainThreadId();
+			// init task memory pool (must outlive the schedulers)
+			async::detail::pool_deallocate(async::detail::pool_allocate(1), 1);
 			// init background scheduler
 			async::invoke(chrono::seconds(0), []{});
 			// init affinitized scheduler
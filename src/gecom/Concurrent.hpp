@@ -2,10 +2,18 @@
 #define GECOM_CONCURRENT_HPP
 
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <new>
 #include <exception>
 #include <stdexcept>
+#include <string>
 #include <unordered_map>
 #include <vector>
+#include <array>
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <deque>
 #include <thread>
 #include <mutex>
@@ -41,33 +49,334 @@ namespace gecom {
 		assertThread(mainThreadId());
 	}
 
+	// set the name of the calling thread, as shown by debuggers and profilers.
+	// may be truncated (to 15 characters on linux). does nothing if unsupported.
+	void setThreadName(const std::string &name);
+
+	// restrict the calling thread to a set of logical cpus; empty means all cpus in cpuCores().
+	// returns false if unsupported or unsuccessful.
+	bool setThreadAffinity(const std::vector<unsigned> &cpus);
+
+	// logical cpus of each physical core (smt siblings share a core), read once.
+	// uses sysfs on linux; elsewhere, or if unavailable, each logical cpu is its own core.
+	// only cpus in the affinity mask of the first caller (normally inherited from the process,
+	// e.g. set by taskset or a cgroup cpuset) are included.
+	const std::vector<std::vector<unsigned>> & cpuCores();
+
 	// asynchronous execution services
 	namespace async {
 
 		using clock = std::chrono::steady_clock;
 
 		// set maximum number of concurrently scheduled background tasks.
-		// must be at least 1.
+		// this is the maximum number of background worker threads; clamped to [1, 256].
 		void concurrency(size_t);
 
 		// get maximum number of concurrently scheduled background tasks.
 		// at least 1.
 		size_t concurrency() noexcept;
 
-		// allow the current background task to be descheduled in favour of a higher priority task.
+		// urgency classes for background tasks. workers run tasks of a more urgent class first;
+		// deadlines order tasks within a class.
+		enum class task_class : unsigned char {
+			// latency-critical work (audio, input)
+			realtime,
+			// work needed for the current frame
+			frame,
+			// default
+			background,
+			// throughput work that can wait (asset decode, precomputation)
+			bulk
+		};
+
+		// handle to a background worker group. each group has its own worker threads, task queues
+		// and concurrency limit, so blocking or bulk work in one group can't hold up another.
+		// a default-constructed handle refers to the default group.
+		class worker_group {
+		private:
+			unsigned m_index = 0;
+
+		public:
+			worker_group() { }
+
+			explicit worker_group(unsigned index_) : m_index(index_) { }
+
+			unsigned index() const noexcept {
+				return m_index;
+			}
+
+			bool operator==(const worker_group &other) const noexcept {
+				return m_index == other.m_index;
+			}
+
+			bool operator!=(const worker_group &other) const noexcept {
+				return m_index != other.m_index;
+			}
+		};
+
+		// get a named worker group, creating it (with concurrency 1) if it doesn't exist.
+		// the default group is named "default". at most 16 groups can exist.
+		worker_group group(const std::string &name);
+
+		// set maximum number of concurrently scheduled tasks in a worker group; clamped to [1, 256]
+		void concurrency(worker_group, size_t);
+
+		// get maximum number of concurrently scheduled tasks in a worker group
+		size_t concurrency(worker_group) noexcept;
+
+		// reserve workers of a group for realtime and frame tasks, so that latency-critical work
+		// always has cores available. at least one worker is always left unreserved.
+		void reserve(worker_group, size_t);
+
+		// get number of workers of a group reserved for realtime and frame tasks
+		size_t reserved(worker_group) noexcept;
+
+		// reserve workers of the default group for realtime and frame tasks
+		void reserve(size_t);
+
+		// get number of workers of the default group reserved for realtime and frame tasks
+		size_t reserved() noexcept;
+
+		// set the minimum number of workers of a group (default 1). these, and any reserved workers,
+		// are started immediately and never retired. more are started on demand, when tasks are submitted
+		// with no idle workers, up to the concurrency limit.
+		void minWorkers(worker_group, size_t);
+
+		// get the minimum number of workers of a group
+		size_t minWorkers(worker_group) noexcept;
+
+		// set how long a worker of a group above the minimum may be idle before its thread exits (default 10s)
+		void idleTimeout(worker_group, clock::duration);
+
+		// get how long a worker of a group above the minimum may be idle before its thread exits
+		clock::duration idleTimeout(worker_group) noexcept;
+
+		// set the minimum number of workers of the default group
+		void minWorkers(size_t);
+
+		// get the minimum number of workers of the default group
+		size_t minWorkers() noexcept;
+
+		// set how long a worker of the default group above the minimum may be idle before its thread exits
+		void idleTimeout(clock::duration);
+
+		// get how long a worker of the default group above the minimum may be idle before its thread exits
+		clock::duration idleTimeout() noexcept;
+
+		// pin each background worker to a single physical core (with its smt siblings).
+		// worker i of each group goes to the i-th core not dedicated to another thread, wrapping around.
+		// when disabled (default), workers may run on any core not dedicated to another thread.
+		void pinWorkers(bool);
+
+		// test if background workers are pinned to physical cores
+		bool pinWorkers() noexcept;
+
+		// dedicate a physical core to the calling thread (e.g. main or render thread).
+		// the thread is pinned to that core and background workers are moved off it.
+		// at least one core is always left for workers. returns the core index, or -1 if none was available.
+		int dedicateCore();
+
+		// allow higher priority (more urgent class or earlier deadline) background tasks to run before the current task continues.
+		// such tasks are run on the current thread before this returns.
 		// if not called from a background task execution thread, does nothing.
 		void yield() noexcept;
 
 		// execute tasks affinitized to the current thread until all tasks have executed or the
 		// specified time budget has lapsed. returns number of tasks executed.
+		// in deterministic mode, on the main thread, also runs background tasks (see deterministic()).
 		size_t execute(clock::duration timebudget) noexcept;
 
+		// number of logical workers if the task engine is in deterministic mode, otherwise 0.
+		// deterministic mode is chosen at startup by setting GECOM_ASYNC_DETERMINISTIC to the number of
+		// logical workers; concurrency() then reports that number for every group. there are no worker
+		// threads: background tasks of all groups run on the main thread inside execute(), in order of
+		// class, deadline and then submission. each execute() call runs the tasks posted to the main thread
+		// and as many background tasks as were queued when it started, ignoring the time budget.
+		// waiting on an async::future (see Future.hpp) from the main thread runs queued background tasks
+		// until it is ready; blocking there on a std::future from invoke() would never return.
+		// execution order is reproducible as long as deadlines and submissions from other threads are.
+		size_t deterministic() noexcept;
+
+		// durations counted in power-of-two buckets of nanoseconds.
+		// bucket 0 is [0, 2ns), bucket i > 0 is [2^i, 2^(i+1)) ns; the last bucket is open-ended.
+		struct duration_histogram {
+			static constexpr size_t bucket_count = 48;
+
+			std::array<uint64_t, bucket_count> buckets {};
+			uint64_t count = 0;
+			clock::duration total = clock::duration::zero();
+			clock::duration max = clock::duration::zero();
+
+			clock::duration mean() const noexcept {
+				return count ? total / clock::rep(count) : clock::duration::zero();
+			}
+
+			// upper bound of the bucket containing the specified quantile (0 to 1)
+			clock::duration quantile(double q) const noexcept {
+				const uint64_t target = uint64_t(q * count);
+				uint64_t seen = 0;
+				for (size_t i = 0; i < bucket_count; i++) {
+					seen += buckets[i];
+					if (seen > target) return std::min<clock::duration>(std::chrono::nanoseconds(uint64_t(2) << i), max);
+				}
+				return max;
+			}
+
+			duration_histogram & operator+=(const duration_histogram &other) noexcept {
+				for (size_t i = 0; i < bucket_count; i++) {
+					buckets[i] += other.buckets[i];
+				}
+				count += other.count;
+				total += other.total;
+				max = std::max(max, other.max);
+				return *this;
+			}
+		};
+
+		// task statistics for one scheduler (or one worker group, or one worker/thread)
+		struct scheduler_stats {
+			// tasks run to completion (or exception)
+			uint64_t tasks_run = 0;
+			// tasks dropped due to cancellation
+			uint64_t tasks_cancelled = 0;
+			// tasks that finished after their deadline
+			uint64_t deadline_misses = 0;
+			// time from submission to start
+			duration_histogram wait_time;
+			// time spent running
+			duration_histogram run_time;
+
+			scheduler_stats & operator+=(const scheduler_stats &other) noexcept {
+				tasks_run += other.tasks_run;
+				tasks_cancelled += other.tasks_cancelled;
+				deadline_misses += other.deadline_misses;
+				wait_time += other.wait_time;
+				run_time += other.run_time;
+				return *this;
+			}
+		};
+
+		struct worker_stats {
+			scheduler_stats tasks;
+			// fraction of the sampling interval spent running tasks
+			double utilisation = 0;
+		};
+
+		struct group_telemetry {
+			std::string name;
+			size_t concurrency = 0;
+			// workers reserved for realtime and frame tasks
+			size_t reserved = 0;
+			// running worker threads (may briefly exceed concurrency if it was lowered)
+			size_t workers = 0;
+			// workers waiting for tasks
+			size_t parked_workers = 0;
+			// queued tasks
+			size_t pending_tasks = 0;
+			// all workers of the group combined
+			scheduler_stats tasks;
+			// per worker
+			std::vector<worker_stats> worker;
+		};
+
+		// point-in-time scheduler telemetry.
+		// counters cover the interval since startup or the last resetTelemetry().
+		struct telemetry_snapshot {
+			// length of the sampling interval
+			clock::duration interval = clock::duration::zero();
+			// default group
+			size_t concurrency = 0;
+			// default group running worker threads (may briefly exceed concurrency if it was lowered)
+			size_t workers = 0;
+			// default group workers waiting for tasks
+			size_t parked_workers = 0;
+			// queued default group tasks
+			size_t pending_tasks = 0;
+			// all background workers (of all groups) combined
+			scheduler_stats background;
+			// all affinitized tasks combined
+			scheduler_stats affinitized;
+			// per default group worker
+			std::vector<worker_stats> worker;
+			// every worker group, default first
+			std::vector<group_telemetry> groups;
+		};
+
+		// collect scheduler telemetry. lock-free; counters are updated concurrently,
+		// so values may be slightly inconsistent with each other.
+		telemetry_snapshot telemetry();
+
+		// restart the telemetry sampling interval
+		void resetTelemetry() noexcept;
+
 		namespace detail {
 
+			// allocate from the task memory pool.
+			// small blocks are recycled through per-thread caches, so steady-state
+			// allocation does not touch the global heap. blocks can be freed on any thread.
+			void * pool_allocate(size_t size);
+
+			// release a block allocated by pool_allocate() with the same size
+			void pool_deallocate(void *p, size_t size) noexcept;
+
+			// construct an object in pooled memory
+			template <typename T, typename ...ArgTR>
+			inline T * pool_new(ArgTR &&...args) {
+				static_assert(alignof(T) <= alignof(std::max_align_t), "over-aligned types cannot be pooled");
+				void *p = pool_allocate(sizeof(T));
+				try {
+					return new (p) T(std::forward<ArgTR>(args)...);
+				} catch (...) {
+					pool_deallocate(p, sizeof(T));
+					throw;
+				}
+			}
+
+			// destroy an object constructed by pool_new()
+			template <typename T>
+			inline void pool_delete(T *p) noexcept {
+				p->~T();
+				pool_deallocate(p, sizeof(T));
+			}
+
+			// allocator for the task memory pool (used for promise shared states)
+			template <typename T>
+			class pool_allocator {
+			public:
+				using value_type = T;
+
+				pool_allocator() { }
+
+				template <typename U>
+				pool_allocator(const pool_allocator<U> &) { }
+
+				T * allocate(size_t n) {
+					return static_cast<T *>(pool_allocate(n * sizeof(T)));
+				}
+
+				void deallocate(T *p, size_t n) noexcept {
+					pool_deallocate(p, n * sizeof(T));
+				}
+
+				template <typename U>
+				bool operator==(const pool_allocator<U> &) const noexcept {
+					return true;
+				}
+
+				template <typename U>
+				bool operator!=(const pool_allocator<U> &) const noexcept {
+					return false;
+				}
+			};
+
 			// run-once, no copy
 			class Runnable : private Uncopyable {
 			public:
 				virtual void run() = 0;
+
+				// destroy this object and release its storage
+				virtual void destroy() noexcept = 0;
+
 				virtual ~Runnable() { }
 			};
 
@@ -78,7 +387,9 @@ namespace gecom {
 				using result_t = decltype(std::declval<FunT>()(std::declval<ArgTR>()...));
 				FunT m_fun;
 				std::tuple<ArgTR...> m_args;
-				std::promise<result_t> m_promise;
+				// the allocator is rebound to the shared state, so its own type is arbitrary
+				// (result_t may be a reference or void)
+				std::promise<result_t> m_promise { std::allocator_arg, pool_allocator<char>() };
 
 				template <typename ResultT, typename Dummy = void>
 				struct call_impl {
@@ -111,22 +422,100 @@ namespace gecom {
 						throw;
 					}
 				}
+
+				virtual void destroy() noexcept override {
+					pool_delete(this);
+				}
+			};
+
+			// call a function with no arguments, discarding any result
+			template <typename FunT>
+			class CallableRunnable : public Runnable {
+			private:
+				FunT m_fun;
+
+			public:
+				explicit CallableRunnable(FunT fun_) : m_fun(std::move(fun_)) { }
+
+				virtual void run() override {
+					m_fun();
+				}
+
+				virtual void destroy() noexcept override {
+					pool_delete(this);
+				}
+			};
+
+			struct runnable_deleter {
+				void operator()(Runnable *r) const noexcept {
+					r->destroy();
+				}
 			};
 
-			using runnable_ptr = std::unique_ptr<Runnable>;
+			using runnable_ptr = std::unique_ptr<Runnable, runnable_deleter>;
 
 			template <typename FunT, typename ...ArgTR>
 			auto make_runnable(FunT &&fun, ArgTR &&...args) {
-				return std::make_unique<BasicRunnable<std::decay_t<FunT &&>, std::decay_t<ArgTR &&>...>>(
+				using runnable_t = BasicRunnable<std::decay_t<FunT &&>, std::decay_t<ArgTR &&>...>;
+				return std::unique_ptr<runnable_t, runnable_deleter>(pool_new<runnable_t>(
 					std::forward<FunT>(fun),
 					std::forward_as_tuple(std::forward<ArgTR>(args)...)
-				);
+				));
+			}
+
+			template <typename FunT>
+			auto make_callable_runnable(FunT &&fun) {
+				using runnable_t = CallableRunnable<std::decay_t<FunT &&>>;
+				return std::unique_ptr<runnable_t, runnable_deleter>(pool_new<runnable_t>(std::forward<FunT>(fun)));
 			}
 			
-			void invoke(std::thread::id affinity, clock::time_point deadline, runnable_ptr taskfun);
+			struct cancel_state {
+				std::atomic<bool> cancelled { false };
+			};
+
+			// in deterministic mode on the main thread, run the most urgent queued background task.
+			// returns false if nothing was run.
+			bool assist() noexcept;
+
+			void invoke(std::thread::id affinity, clock::time_point deadline, runnable_ptr taskfun, std::shared_ptr<cancel_state> cancel = nullptr);
+
+			void invoke(worker_group group, task_class cls, clock::time_point deadline, runnable_ptr taskfun, std::shared_ptr<cancel_state> cancel = nullptr);
+
+			// submit a task to its scheduler once the due time has passed
+			void invokeAt(clock::time_point due, std::thread::id affinity, clock::time_point deadline, runnable_ptr taskfun);
 
 		}
 
+		// cooperative cancellation for tasks; copies share the same state.
+		// a task invoked with a token is dropped without running if the token is cancelled
+		// before it starts (its future then reports broken_promise). cancelled tasks stay queued,
+		// holding their captures, until they reach the front of their queue and are discarded;
+		// cancelling is O(1) and costs queues nothing. a running task can check cancelled() to stop early.
+		class cancellation_token {
+		private:
+			std::shared_ptr<detail::cancel_state> m_state;
+
+		public:
+			cancellation_token() : m_state(std::allocate_shared<detail::cancel_state>(detail::pool_allocator<detail::cancel_state>())) { }
+
+			bool cancelled() const noexcept {
+				return m_state->cancelled.load(std::memory_order_acquire);
+			}
+
+			// request cancellation; returns true iff this call cancelled the token
+			bool cancel() noexcept {
+				return !m_state->cancelled.exchange(true);
+			}
+
+			const std::shared_ptr<detail::cancel_state> & state() const noexcept {
+				return m_state;
+			}
+		};
+
+		// test if the current task was invoked with a cancellation token that has since been cancelled.
+		// returns false if not called from a task.
+		bool cancelled() noexcept;
+
 		// invoke an affinitized task (absolute deadline)
 		template <typename TaskFunT, typename ...ArgTR>
 		inline auto invoke(std::thread::id affinity, clock::time_point deadline, TaskFunT &&taskfun, ArgTR &&...args) -> std::future<decltype(taskfun(args...))> {
@@ -155,6 +544,69 @@ namespace gecom {
 			return invoke(clock::now() + deadline, std::forward<TaskFunT>(taskfun), std::forward<ArgTR>(args)...);
 		}
 
+		// invoke a cancellable affinitized task (absolute deadline)
+		template <typename TaskFunT, typename ...ArgTR>
+		inline auto invoke(const cancellation_token &token, std::thread::id affinity, clock::time_point deadline, TaskFunT &&taskfun, ArgTR &&...args) -> std::future<decltype(taskfun(args...))> {
+			auto r = detail::make_runnable(std::forward<TaskFunT>(taskfun), std::forward<ArgTR>(args)...);
+			auto f = r->getFuture();
+			detail::invoke(std::move(affinity), std::move(deadline), std::move(r), token.state());
+			return f;
+		}
+
+		// invoke a cancellable affinitized task (relative deadline)
+		template <typename TaskFunT, typename ...ArgTR>
+		inline auto invoke(const cancellation_token &token, std::thread::id affinity, clock::duration deadline, TaskFunT &&taskfun, ArgTR &&...args) -> std::future<decltype(taskfun(args...))> {
+			return invoke(token, std::move(affinity), clock::now() + deadline, std::forward<TaskFunT>(taskfun), std::forward<ArgTR>(args)...);
+		}
+
+		// invoke a cancellable background task (absolute deadline)
+		template <typename TaskFunT, typename ...ArgTR>
+		inline auto invoke(const cancellation_token &token, clock::time_point deadline, TaskFunT &&taskfun, ArgTR &&...args) -> std::future<decltype(taskfun(args...))> {
+			return invoke(token, std::thread::id(), std::move(deadline), std::forward<TaskFunT>(taskfun), std::forward<ArgTR>(args)...);
+		}
+
+		// invoke a cancellable background task (relative deadline)
+		template <typename TaskFunT, typename ...ArgTR>
+		inline auto invoke(const cancellation_token &token, clock::duration deadline, TaskFunT &&taskfun, ArgTR &&...args) -> std::future<decltype(taskfun(args...))> {
+			return invoke(token, std::thread::id(), clock::now() + deadline, std::forward<TaskFunT>(taskfun), std::forward<ArgTR>(args)...);
+		}
+
+		// invoke a background task in a worker group with an urgency class (absolute deadline)
+		template <typename TaskFunT, typename ...ArgTR>
+		inline auto invoke(worker_group group, task_class cls, clock::time_point deadline, TaskFunT &&taskfun, ArgTR &&...args) -> std::future<decltype(taskfun(args...))> {
+			auto r = detail::make_runnable(std::forward<TaskFunT>(taskfun), std::forward<ArgTR>(args)...);
+			auto f = r->getFuture();
+			detail::invoke(group, cls, std::move(deadline), std::move(r));
+			return f;
+		}
+
+		// invoke a background task in a worker group with an urgency class (relative deadline)
+		template <typename TaskFunT, typename ...ArgTR>
+		inline auto invoke(worker_group group, task_class cls, clock::duration deadline, TaskFunT &&taskfun, ArgTR &&...args) -> std::future<decltype(taskfun(args...))> {
+			return invoke(group, cls, clock::now() + deadline, std::forward<TaskFunT>(taskfun), std::forward<ArgTR>(args)...);
+		}
+
+		// invoke a background task with an urgency class (absolute deadline)
+		template <typename TaskFunT, typename ...ArgTR>
+		inline auto invoke(task_class cls, clock::time_point deadline, TaskFunT &&taskfun, ArgTR &&...args) -> std::future<decltype(taskfun(args...))> {
+			return invoke(worker_group(), cls, std::move(deadline), std::forward<TaskFunT>(taskfun), std::forward<ArgTR>(args)...);
+		}
+
+		// invoke a background task with an urgency class (relative deadline)
+		template <typename TaskFunT, typename ...ArgTR>
+		inline auto invoke(task_class cls, clock::duration deadline, TaskFunT &&taskfun, ArgTR &&...args) -> std::future<decltype(taskfun(args...))> {
+			return invoke(worker_group(), cls, clock::now() + deadline, std::forward<TaskFunT>(taskfun), std::forward<ArgTR>(args)...);
+		}
+
+		// invoke a cancellable background task in a worker group with an urgency class (absolute deadline)
+		template <typename TaskFunT, typename ...ArgTR>
+		inline auto invoke(const cancellation_token &token, worker_group group, task_class cls, clock::time_point deadline, TaskFunT &&taskfun, ArgTR &&...args) -> std::future<decltype(taskfun(args...))> {
+			auto r = detail::make_runnable(std::forward<TaskFunT>(taskfun), std::forward<ArgTR>(args)...);
+			auto f = r->getFuture();
+			detail::invoke(group, cls, std::move(deadline), std::move(r), token.state());
+			return f;
+		}
+
 		// invoke a task affinitized to the main thread (absolute deadline)
 		template <typename TaskFunT, typename ...ArgTR>
 		inline auto invokeMain(clock::time_point deadline, TaskFunT &&taskfun, ArgTR &&...args) -> std::future<decltype(taskfun(args...))> {
@@ -166,6 +618,34 @@ namespace gecom {
 		inline auto invokeMain(clock::duration deadline, TaskFunT &&taskfun, ArgTR &&...args) -> std::future<decltype(taskfun(args...))> {
 			return invokeMain(clock::now() + deadline, std::forward<TaskFunT>(taskfun), std::forward<ArgTR>(args)...);
 		}
+
+		// invoke an affinitized task no earlier than the specified time.
+		// the task is queued at its due time, with that as its deadline.
+		template <typename TaskFunT, typename ...ArgTR>
+		inline auto invokeAt(std::thread::id affinity, clock::time_point due, TaskFunT &&taskfun, ArgTR &&...args) -> std::future<decltype(taskfun(args...))> {
+			auto r = detail::make_runnable(std::forward<TaskFunT>(taskfun), std::forward<ArgTR>(args)...);
+			auto f = r->getFuture();
+			detail::invokeAt(due, std::move(affinity), due, std::move(r));
+			return f;
+		}
+
+		// invoke a background task no earlier than the specified time
+		template <typename TaskFunT, typename ...ArgTR>
+		inline auto invokeAt(clock::time_point due, TaskFunT &&taskfun, ArgTR &&...args) -> std::future<decltype(taskfun(args...))> {
+			return invokeAt(std::thread::id(), due, std::forward<TaskFunT>(taskfun), std::forward<ArgTR>(args)...);
+		}
+
+		// invoke an affinitized task after (at least) the specified delay
+		template <typename TaskFunT, typename ...ArgTR>
+		inline auto invokeAfter(std::thread::id affinity, clock::duration delay, TaskFunT &&taskfun, ArgTR &&...args) -> std::future<decltype(taskfun(args...))> {
+			return invokeAt(std::move(affinity), clock::now() + delay, std::forward<TaskFunT>(taskfun), std::forward<ArgTR>(args)...);
+		}
+
+		// invoke a background task after (at least) the specified delay
+		template <typename TaskFunT, typename ...ArgTR>
+		inline auto invokeAfter(clock::duration delay, TaskFunT &&taskfun, ArgTR &&...args) -> std::future<decltype(taskfun(args...))> {
+			return invokeAt(std::thread::id(), clock::now() + delay, std::forward<TaskFunT>(taskfun), std::forward<ArgTR>(args)...);
+		}
 	}
 
 	class interruption { };
@@ -193,8 +673,89 @@ namespace gecom {
 
 	using subscription_ptr = std::unique_ptr<Subscription>;
 
+	namespace async {
+
+		namespace detail {
+
+			struct periodic_state {
+				std::function<void()> fun;
+				std::thread::id affinity;
+				clock::duration period;
+				std::atomic<bool> enabled { true };
+				std::atomic<bool> cancelled { false };
+			};
+
+			// run a periodic task from the due time until cancelled
+			void invokePeriodic(clock::time_point due, std::shared_ptr<periodic_state> state);
+
+			class PeriodicSubscription : public Subscription {
+			private:
+				std::shared_ptr<periodic_state> m_state;
+
+			public:
+				explicit PeriodicSubscription(std::shared_ptr<periodic_state> state_) : m_state(std::move(state_)) { }
+
+				virtual operator bool() override {
+					return bool(m_state);
+				}
+
+				virtual bool enabled() override {
+					return m_state && m_state->enabled;
+				}
+
+				virtual bool enable(bool b) override {
+					if (!m_state) return false;
+					m_state->enabled = b;
+					return true;
+				}
+
+				virtual bool cancel() noexcept override {
+					if (!m_state) return false;
+					m_state->cancelled = true;
+					m_state.reset();
+					return true;
+				}
+
+				virtual void forever() override {
+					m_state.reset();
+				}
+
+				virtual ~PeriodicSubscription() {
+					cancel();
+				}
+			};
+
+		}
+
+		// invoke an affinitized task every period, starting one period from now, until the subscription is cancelled.
+		// each run is queued at its due time, with that as its deadline. the next run is not queued
+		// until the previous one has finished; runs that would be late by a whole period are skipped.
+		// disabling the subscription skips runs without cancelling.
+		template <typename FunT>
+		inline subscription_ptr invokeEvery(std::thread::id affinity, clock::duration period, FunT &&fun) {
+			assert(period > clock::duration::zero());
+			auto state = std::allocate_shared<detail::periodic_state>(detail::pool_allocator<detail::periodic_state>());
+			state->fun = std::forward<FunT>(fun);
+			state->affinity = affinity;
+			state->period = period;
+			detail::invokePeriodic(clock::now() + period, state);
+			return std::make_unique<detail::PeriodicSubscription>(std::move(state));
+		}
+
+		// invoke a background task every period until the subscription is cancelled
+		template <typename FunT>
+		inline subscription_ptr invokeEvery(clock::duration period, FunT &&fun) {
+			return invokeEvery(std::thread::id(), period, std::forward<FunT>(fun));
+		}
+
+	}
+
 
 	// event dispatch mechanism.
+	// observers are held in an immutable snapshot that notify() reads without locking;
+	// subscribing or detaching publishes a new snapshot, and old ones are freed once
+	// no notify() can still be reading them. observers may subscribe to or cancel
+	// observers of the same event (including themselves) while being notified.
 	template <typename EventArgT>
 	class Event : private Uncopyable {
 	public:
@@ -203,42 +764,255 @@ namespace gecom {
 
 	private:
 		// notify count, determines if wakeup was intended
-		unsigned m_count = 0;
-		// currently-waiting-threads count
-		unsigned m_waiters = 0;
+		std::atomic<unsigned> m_count { 0 };
+		// currently-waiting-threads count; notify() only touches the condition variable if nonzero
+		std::atomic<unsigned> m_waiters { 0 };
+		// interrupt count, protected by the mutex
+		unsigned m_interrupts = 0;
+		// set by the destructor, protected by the mutex
+		bool m_dying = false;
 		// this cannot be a recursive mutex because of the condition variable
-		// protects the event as a whole, and used for waiting
+		// used for waiting
 		std::mutex m_mutex;
 		std::condition_variable m_cond;
 
+		// an observer; the callable is stored inline
+		struct observer_node : private Uncopyable {
+			unsigned key = 0;
+			std::atomic<bool> enabled { true };
+			// set when detached; no new calls are started after this
+			std::atomic<bool> cancelled { false };
+			// calls in progress, so cancel() can wait for them
+			std::atomic<unsigned> calls { 0 };
+
+			virtual bool call(const EventArgT &) = 0;
+
+			virtual ~observer_node() { }
+		};
+
+		template <typename FunT>
+		struct observer_impl : observer_node {
+			FunT fun;
+
+			template <typename FunTR>
+			explicit observer_impl(FunTR &&fun_) : fun(std::forward<FunTR>(fun_)) { }
+
+			virtual bool call(const EventArgT &e) override {
+				return fun(e);
+			}
+		};
+
+		// immutable observer snapshot
+		struct observer_list {
+			std::vector<std::shared_ptr<observer_node>> observers;
+			// next retired snapshot
+			observer_list *next = nullptr;
+			// phase in which this snapshot was retired
+			unsigned retired_phase = 0;
+		};
+
 		struct observer_registry {
 			// protects only observer attachment/detachment
 			std::mutex mutex;
 			// next observer attachment key
 			unsigned next_key = 0;
-			// observers: enabled + callback
-			std::unordered_map<unsigned, std::pair<bool, observer_t>> observers;
+			// current snapshot; null if there are no observers
+			std::atomic<observer_list *> current { nullptr };
+			// notify() calls that may be reading a snapshot, counted by the parity of the phase they started in.
+			// the phase only advances (under the mutex) once the readers of the previous phase have finished,
+			// so new readers never join a count that is waited on.
+			std::atomic<unsigned> readers[2];
+			std::atomic<unsigned> phase { 0 };
+			// replaced snapshots, newest first
+			std::atomic<observer_list *> retired { nullptr };
+
+			// free retired snapshots that nothing can be reading; mutex assumed owned.
+			// a snapshot retired in phase p can only be read by readers from phase p or earlier,
+			// and those have all finished once the phase reaches p + 2. so under continuous notify()
+			// traffic, retired snapshots are freed within about two notify() durations.
+			void reclaimLocked() {
+				observer_list *l = retired.load();
+				if (!l) return;
+				// advance the phase (at most twice) while the previous phase has no readers
+				for (int i = 0; i < 2 && phase.load() - l->retired_phase < 2; i++) {
+					const unsigned p = phase.load();
+					if (readers[(p + 1) & 1].load()) break;
+					phase.store(p + 1);
+				}
+				// find the first snapshot old enough; everything after it is older
+				const unsigned p = phase.load();
+				observer_list *prev = nullptr;
+				while (l && p - l->retired_phase < 2) {
+					prev = l;
+					l = l->next;
+				}
+				if (prev) {
+					prev->next = nullptr;
+				} else {
+					retired.store(nullptr);
+				}
+				while (l) {
+					observer_list *n = l->next;
+					delete l;
+					l = n;
+				}
+			}
+
+			// replace the current snapshot with a copy filtered by pred (and optionally with an observer added).
+			// mutex assumed owned.
+			template <typename PredT>
+			void publishLocked(PredT pred, std::shared_ptr<observer_node> add = nullptr) {
+				observer_list *old = current.load();
+				observer_list *l = new observer_list();
+				if (old) {
+					for (auto &o : old->observers) {
+						if (pred(*o)) l->observers.push_back(o);
+					}
+				}
+				if (add) l->observers.push_back(std::move(add));
+				if (l->observers.empty()) {
+					delete l;
+					l = nullptr;
+				}
+				current.store(l);
+				if (old) {
+					// readers that can see the old snapshot started no later than the phase read after replacing it
+					old->retired_phase = phase.load();
+					old->next = retired.load();
+					retired.store(old);
+				}
+				reclaimLocked();
+			}
+
+			// observer with the given key in the current snapshot, or null; mutex assumed owned
+			observer_node * findLocked(unsigned key) {
+				observer_list *l = current.load();
+				if (!l) return nullptr;
+				for (auto &o : l->observers) {
+					if (o->key == key) return o.get();
+				}
+				return nullptr;
+			}
+
+			// remove observers that have been cancelled
+			void detachCancelled() {
+				std::unique_lock<std::mutex> lock(mutex);
+				publishLocked([](const observer_node &o) { return !o.cancelled.load(); });
+			}
+
+			observer_registry() {
+				readers[0] = 0;
+				readers[1] = 0;
+			}
+
+			~observer_registry() {
+				delete current.load();
+				observer_list *l = retired.exchange(nullptr);
+				while (l) {
+					observer_list *n = l->next;
+					delete l;
+					l = n;
+				}
+			}
 		};
 
 		// returned subscriptions maintain a weak_ptr to this so cancellation
 		// can happen regardless of whether the event is alive
 		std::shared_ptr<observer_registry> m_registry;
 
+		// counts a notify() as a snapshot reader for its lifetime, and the observer it is calling.
+		// readers in progress on each thread are linked so that cancel() can avoid waiting for itself.
+		class reader_guard {
+		private:
+			observer_registry *m_reg;
+			reader_guard *m_prev;
+			unsigned m_phase;
+			observer_node *m_calling = nullptr;
+
+			static reader_guard *& top() {
+				static thread_local reader_guard *r = nullptr;
+				return r;
+			}
+
+		public:
+			explicit reader_guard(observer_registry *reg_) : m_reg(reg_), m_prev(top()) {
+				// if the phase advanced before we were counted, count again in the new phase
+				unsigned p = m_reg->phase.load();
+				while (true) {
+					m_reg->readers[p & 1]++;
+					const unsigned p2 = m_reg->phase.load();
+					if (p2 == p) break;
+					m_reg->readers[p & 1]--;
+					p = p2;
+				}
+				m_phase = p & 1;
+				top() = this;
+			}
+
+			// set the observer being called (or null), counting it as a call in progress
+			void calling(observer_node *o) {
+				if (m_calling) m_calling->calls--;
+				m_calling = o;
+				if (m_calling) m_calling->calls++;
+			}
+
+			// number of calls of an observer in progress on this thread
+			static unsigned count(const observer_node *o) {
+				unsigned n = 0;
+				for (reader_guard *r = top(); r; r = r->m_prev) {
+					if (r->m_calling == o) n++;
+				}
+				return n;
+			}
+
+			~reader_guard() {
+				top() = m_prev;
+				if (m_calling) m_calling->calls--;
+				m_reg->readers[m_phase]--;
+				if (m_reg->retired.load()) {
+					// if a writer holds the lock, it will reclaim
+					std::unique_lock<std::mutex> lock(m_reg->mutex, std::try_to_lock);
+					if (lock) m_reg->reclaimLocked();
+				}
+			}
+		};
+
 		// ensures that the wait-count is maintained in an exception-safe manner
+		// mutex assumed owned for the lifetime of the guard
 		class waiter_guard {
 		private:
-			unsigned *m_waiters;
+			Event *m_event;
 
 		public:
-			waiter_guard(unsigned *waiters_) : m_waiters(waiters_) {
-				(*m_waiters)++;
+			waiter_guard(Event *event_) : m_event(event_) {
+				m_event->m_waiters++;
 			}
 
 			~waiter_guard() {
-				(*m_waiters)--;
+				// the destructor waits for the last waiter to leave
+				if (--m_event->m_waiters == 0 && m_event->m_dying) m_event->m_cond.notify_all();
 			}
 		};
 
+		// wait until pred() is true, re-checking after each notify.
+		// cond_wait(lock, wake) waits on the condition variable until wake() is true,
+		// returning false if it timed out. returns pred() after a timeout or interrupt.
+		template <typename PredT, typename CondWaitT>
+		bool waitImpl(PredT pred, CondWaitT cond_wait) {
+			std::unique_lock<std::mutex> lock(m_mutex);
+			waiter_guard waiter(this);
+			const unsigned interrupts0 = m_interrupts;
+			// the notify count must be read after registering as a waiter, and before checking pred
+			unsigned count0 = m_count.load();
+			while (!pred()) {
+				auto wake = [&]() { return m_count.load() != count0 || m_interrupts != interrupts0; };
+				if (!cond_wait(lock, wake)) return pred();
+				if (m_interrupts != interrupts0) return pred();
+				count0 = m_count.load();
+			}
+			return true;
+		}
+
 		// subscription type for this event type
 		class EventSubscription : public Subscription {
 		private:
@@ -256,28 +1030,44 @@ namespace gecom {
 				auto spreg = m_wpreg.lock();
 				if (!spreg) return false;
 				std::unique_lock<std::mutex> lock(spreg->mutex);
-				auto it = spreg->observers.find(m_key);
-				if (it == spreg->observers.end()) return false;
-				return it->second.first;
+				auto o = spreg->findLocked(m_key);
+				return o && o->enabled;
 			}
 
 			virtual bool enable(bool b) override {
 				auto spreg = m_wpreg.lock();
 				if (!spreg) return false;
 				std::unique_lock<std::mutex> lock(spreg->mutex);
-				auto it = spreg->observers.find(m_key);
-				if (it == spreg->observers.end()) return false;
-				it->second.first = b;
+				auto o = spreg->findLocked(m_key);
+				if (!o) return false;
+				o->enabled = b;
 				return true;
 			}
 
 			virtual bool cancel() noexcept override {
 				auto spreg = m_wpreg.lock();
 				if (!spreg) return false;
-				std::unique_lock<std::mutex> lock(spreg->mutex);
-				bool r = spreg->observers.erase(m_key);
 				m_wpreg.reset();
-				return r;
+				std::shared_ptr<observer_node> node;
+				{
+					std::unique_lock<std::mutex> lock(spreg->mutex);
+					observer_list *l = spreg->current.load();
+					if (!l) return false;
+					for (auto &o : l->observers) {
+						if (o->key == m_key) node = o;
+					}
+					if (!node || node->cancelled.exchange(true)) return false;
+					spreg->publishLocked([&](const observer_node &o) { return &o != node.get(); });
+				}
+				// wait for calls in progress on other threads, so the observer is never
+				// called after this returns. calls in progress on this thread are the caller.
+				// calls are counted before checking the cancelled flag, so any call that
+				// has not been counted yet will see it.
+				const unsigned self = reader_guard::count(node.get());
+				while (node->calls.load() > self) {
+					std::this_thread::yield();
+				}
+				return true;
 			}
 
 			virtual void forever() override {
@@ -296,84 +1086,121 @@ namespace gecom {
 		// the observer will be removed when the returned subscription is destroyed or
 		// has cancel() otherwise called on it, when the event is destroyed,
 		// or when the observer returns true, whichever is first.
-		subscription_ptr subscribe(observer_t func) {
+		// an observer subscribed during notify() is first called on the next notify().
+		// if the event is notified from several threads, observers may be called concurrently.
+		template <typename FunT>
+		subscription_ptr subscribe(FunT &&func) {
+			using impl_t = observer_impl<std::decay_t<FunT>>;
+			std::shared_ptr<observer_node> node = std::make_shared<impl_t>(std::forward<FunT>(func));
 			std::unique_lock<std::mutex> lock(m_registry->mutex);
 			unsigned key = m_registry->next_key++;
-			m_registry->observers[key] = std::make_pair(true, std::move(func));
+			node->key = key;
+			m_registry->publishLocked([](const observer_node &) { return true; }, std::move(node));
 			return std::make_unique<EventSubscription>(m_registry, key);
 		}
 
+		// wake all waiting threads without notifying
 		void interrupt() {
-			// wake all waiting threads
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_interrupts++;
+			}
 			m_cond.notify_all();
 		}
 
 		// notify this event; wakes all waiting threads
 		void notify(const EventArgT &e) {
+			observer_registry *reg = m_registry.get();
+			bool detach = false;
 			{
-				// use a new scope so the condition is notified after the mutexes are unlocked
-				std::unique_lock<std::mutex> lock(m_registry->mutex);
-				std::unique_lock<std::mutex> lock2(m_mutex);
-				// increment notify count to signal that wakeups are valid
-				m_count++;
-				// do we have observers?
-				if (!m_registry->observers.empty()) {
-					// keep a list of observers requesting detachment while calling them
-					std::vector<unsigned> detach_keys;
-					for (const auto &entry : m_registry->observers) {
+				reader_guard reader(reg);
+				if (observer_list *l = reg->current.load()) {
+					for (const auto &o : l->observers) {
+						reader.calling(o.get());
 						// skip if disabled
-						if (!entry.second.first) continue;
-						// call observer
-						if (entry.second.second(e)) {
-							detach_keys.push_back(entry.first);
-						}
-					}
-					// perform detachments
-					for (auto key : detach_keys) {
-						m_registry->observers.erase(key);
+						if (!o->enabled.load(std::memory_order_relaxed)) continue;
+						// skip if detached since the snapshot was taken
+						if (o->cancelled.load()) continue;
+						// call observer; detach if requested
+						if (o->call(e) && !o->cancelled.exchange(true)) detach = true;
 					}
+					reader.calling(nullptr);
 				}
 			}
-			// wake waiting threads
-			m_cond.notify_all();
+			// perform detachments
+			if (detach) reg->detachCancelled();
+			// increment notify count to signal that wakeups are valid
+			m_count++;
+			// wake waiting threads, if any. a waiter increments the waiter count before
+			// reading the notify count, so either it sees this notify or we see it.
+			if (m_waiters.load()) {
+				// ensure waiters are blocked on the condition variable, not between checking and waiting
+				{ std::unique_lock<std::mutex> lock(m_mutex); }
+				m_cond.notify_all();
+			}
 		}
 
-		// wait on this event; returns true if the event was fired
+		// wait on this event; returns true if the event was fired, false if interrupted
 		bool wait() {
 			// no need to lock the observer registry
-			std::unique_lock<std::mutex> lock(m_mutex);
-			waiter_guard waiter(&m_waiters);
-			// record the notify count at start of waiting
-			unsigned count0 = m_count;
-			// if this thread was interrupted while waiting, this will throw
-			m_cond.wait(lock);
-			// if the notify count changed, the event was triggered
-			return m_count != count0;
+			const unsigned count0 = m_count.load();
+			return waitImpl(
+				[&]() { return m_count.load() != count0; },
+				[&](auto &lock, auto wake) { m_cond.wait(lock, wake); return true; }
+			);
+		}
+
+		// wait on this event with a timeout; returns true if the event was fired,
+		// false if timed out or interrupted
+		template <typename ClockT, typename DurationT>
+		bool wait_until(const std::chrono::time_point<ClockT, DurationT> &timeout) {
+			const unsigned count0 = m_count.load();
+			return waitImpl(
+				[&]() { return m_count.load() != count0; },
+				[&](auto &lock, auto wake) { return m_cond.wait_until(lock, timeout, wake); }
+			);
 		}
 
-		// TODO timed wait etc
+		template <typename RepT, typename PeriodT>
+		bool wait_for(const std::chrono::duration<RepT, PeriodT> &timeout) {
+			return wait_until(std::chrono::steady_clock::now() + timeout);
+		}
+
+		// wait until pred() is true, checking it first and then after each notify.
+		// returns the last result of pred(), which is false only if interrupted.
+		// pred is called with the event's internal lock held and must not wait on or notify this event.
+		template <typename PredT>
+		bool wait(PredT pred) {
+			return waitImpl(pred, [&](auto &lock, auto wake) { m_cond.wait(lock, wake); return true; });
+		}
+
+		// wait until pred() is true, with a timeout; returns the last result of pred()
+		template <typename ClockT, typename DurationT, typename PredT>
+		bool wait_until(const std::chrono::time_point<ClockT, DurationT> &timeout, PredT pred) {
+			return waitImpl(pred, [&](auto &lock, auto wake) { return m_cond.wait_until(lock, timeout, wake); });
+		}
+
+		template <typename RepT, typename PeriodT, typename PredT>
+		bool wait_for(const std::chrono::duration<RepT, PeriodT> &timeout, PredT pred) {
+			return wait_until(std::chrono::steady_clock::now() + timeout, pred);
+		}
 
 		virtual ~Event() {
 			section_guard sec("Event");
 			// clear the observer registry to release memory
 			{
 				std::unique_lock<std::mutex> lock(m_registry->mutex);
-				m_registry->observers = { };
+				m_registry->publishLocked([](const observer_node &) { return false; });
 			}
-			// interrupt all waiting threads, then wait for them to unlock the mutex
-			auto time0 = std::chrono::steady_clock::now();
-			while (true) {
-				// interrupt any threads waiting on this event still
-				interrupt();
-				std::this_thread::yield();
-				std::unique_lock<std::mutex> lock(m_mutex);
-				// test if we can go home yet
-				if (m_waiters == 0) break;
-				if (std::chrono::steady_clock::now() - time0 > std::chrono::milliseconds(100)) {
-					// failed to finish within timeout
-					Log::error() << "Destructor failed to finish within timeout";
-					std::abort();
-				}
+			// interrupt all waiting threads, then wait for them to leave
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_dying = true;
+			m_interrupts++;
+			m_cond.notify_all();
+			if (!m_cond.wait_for(lock, std::chrono::milliseconds(100), [&]() { return m_waiters.load() == 0; })) {
+				// failed to finish within timeout
+				Log::error() << "Destructor failed to finish within timeout";
+				std::abort();
 			}
 		}
 	};
@@ -385,6 +1212,8 @@ namespace gecom {
 		std::mutex m_mutex;
 		std::condition_variable m_condition;
 		std::deque<T> m_queue;
+		// interrupt count, so spurious wakeups are not mistaken for interruption
+		unsigned m_interrupts = 0;
 
 	public:
 		blocking_queue() { }
@@ -420,6 +1249,10 @@ namespace gecom {
 		}
 
 		void interrupt() {
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_interrupts++;
+			}
 			// wake up all waiters
 			m_condition.notify_all();
 		}
@@ -435,9 +1268,9 @@ namespace gecom {
 		T pop() {
 			std::unique_lock<std::mutex> lock(m_mutex);
 			if (m_queue.empty()) {
-				// wait for push
-				m_condition.wait(lock);
-				// push wakes up only one waiter, so if queue is still empty waiting was interrupted
+				// wait for push or interrupt
+				const unsigned interrupts0 = m_interrupts;
+				m_condition.wait(lock, [&]() { return !m_queue.empty() || m_interrupts != interrupts0; });
 				if (m_queue.empty()) throw interruption();
 			}
 			T rc(std::move(m_queue.back()));
@@ -460,6 +1293,562 @@ namespace gecom {
 
 	};
 
+	namespace detail {
+
+		// blocking support for the ring queues. threads block only when a ring is full or empty,
+		// so the fast path of push and pop just checks whether anyone needs waking. each blocked
+		// thread is woken at most once per wakeup, so a burst of pops doesn't repeatedly signal
+		// a producer that hasn't run yet.
+		class ring_parking : private Uncopyable {
+		private:
+			struct waiter {
+				std::condition_variable cond;
+				bool signalled = false;
+				waiter *prev = nullptr;
+				waiter *next = nullptr;
+			};
+
+			// blocked threads, oldest first
+			struct waiter_list {
+				waiter *head = nullptr;
+				waiter *tail = nullptr;
+				std::atomic<unsigned> count { 0 };
+
+				void push(waiter *w) {
+					w->prev = tail;
+					w->next = nullptr;
+					(tail ? tail->next : head) = w;
+					tail = w;
+					count++;
+				}
+
+				void remove(waiter *w) {
+					(w->prev ? w->prev->next : head) = w->next;
+					(w->next ? w->next->prev : tail) = w->prev;
+					w->prev = w->next = nullptr;
+					count--;
+				}
+
+				// remove and signal the oldest waiter
+				void signal() {
+					waiter *w = head;
+					remove(w);
+					w->signalled = true;
+					w->cond.notify_one();
+				}
+			};
+
+			std::mutex m_mutex;
+			waiter_list m_push_waiters, m_pop_waiters;
+			// interrupt count, protected by the mutex
+			unsigned m_interrupts = 0;
+
+			template <typename ReadyT>
+			void park(waiter_list &list, ReadyT ready) {
+				std::unique_lock<std::mutex> lock(m_mutex);
+				const unsigned interrupts0 = m_interrupts;
+				waiter w;
+				while (true) {
+					list.push(&w);
+					// pairs with the fence in wake(): either the waker sees us, or we see its change
+					std::atomic_thread_fence(std::memory_order_seq_cst);
+					if (ready()) break;
+					w.cond.wait(lock, [&]() { return w.signalled || m_interrupts != interrupts0; });
+					if (!w.signalled) break;
+					w.signalled = false;
+					// the waker removed us; retry unless another thread got there first
+					if (ready()) return;
+				}
+				if (!w.signalled) list.remove(&w);
+				if (m_interrupts != interrupts0) throw interruption();
+			}
+
+			void wake(waiter_list &list, bool all) {
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				if (!list.count.load(std::memory_order_relaxed)) return;
+				std::unique_lock<std::mutex> lock(m_mutex);
+				if (all) {
+					while (list.head) list.signal();
+				} else if (list.head) {
+					list.signal();
+				}
+			}
+
+		public:
+			// block until ready() (space to push); throws interruption if interrupted
+			template <typename ReadyT>
+			void parkPush(ReadyT ready) {
+				park(m_push_waiters, ready);
+			}
+
+			// block until ready() (elements to pop); throws interruption if interrupted
+			template <typename ReadyT>
+			void parkPop(ReadyT ready) {
+				park(m_pop_waiters, ready);
+			}
+
+			// call after popping
+			void wakePush(bool all = false) {
+				wake(m_push_waiters, all);
+			}
+
+			// call after pushing
+			void wakePop(bool all = false) {
+				wake(m_pop_waiters, all);
+			}
+
+			void interrupt() {
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_interrupts++;
+				while (m_push_waiters.head) m_push_waiters.signal();
+				while (m_pop_waiters.head) m_pop_waiters.signal();
+			}
+		};
+
+		inline size_t ring_capacity(size_t capacity) {
+			// power of 2, at least 2
+			size_t c = 2;
+			while (c < capacity) c <<= 1;
+			return c;
+		}
+
+	}
+
+	// bounded multi-producer multi-consumer ring queue.
+	// capacity is rounded up to a power of 2. try_ operations never block; the others block
+	// while the ring is full (push) or empty (pop), and throw interruption if interrupted.
+	// batch operations claim several slots at once, so contend once per batch rather than per element.
+	// T's constructors must not throw.
+	template <typename T>
+	class mpmc_ring : private Uncopyable {
+	private:
+		static constexpr size_t cache_line = 64;
+
+		struct cell {
+			// == position: free for the producer of that position
+			// == position + 1: full, for the consumer of that position
+			std::atomic<size_t> seq;
+			alignas(T) unsigned char storage[sizeof(T)];
+
+			T * get() noexcept {
+				return reinterpret_cast<T *>(storage);
+			}
+		};
+
+		const size_t m_mask;
+		std::unique_ptr<cell[]> m_cells;
+		detail::ring_parking m_parking;
+
+		// producer and consumer positions on separate cache lines
+		alignas(cache_line) std::atomic<size_t> m_push_pos { 0 };
+		alignas(cache_line) std::atomic<size_t> m_pop_pos { 0 };
+		char m_pad[cache_line - sizeof(std::atomic<size_t>)];
+
+		// claim up to n consecutive free cells; returns the number claimed, and the first position in pos
+		size_t claimPush(size_t n, size_t &pos) {
+			pos = m_push_pos.load(std::memory_order_relaxed);
+			while (true) {
+				size_t k = 0;
+				while (k < n) {
+					size_t seq = m_cells[(pos + k) & m_mask].seq.load(std::memory_order_acquire);
+					if (seq != pos + k) break;
+					k++;
+				}
+				if (!k) {
+					// full, or another producer moved on
+					size_t seq = m_cells[pos & m_mask].seq.load(std::memory_order_acquire);
+					if (intptr_t(seq - pos) < 0) return 0;
+					pos = m_push_pos.load(std::memory_order_relaxed);
+					continue;
+				}
+				if (m_push_pos.compare_exchange_weak(pos, pos + k, std::memory_order_relaxed)) return k;
+			}
+		}
+
+		// claim up to n consecutive full cells; returns the number claimed, and the first position in pos
+		size_t claimPop(size_t n, size_t &pos) {
+			pos = m_pop_pos.load(std::memory_order_relaxed);
+			while (true) {
+				size_t k = 0;
+				while (k < n) {
+					size_t seq = m_cells[(pos + k) & m_mask].seq.load(std::memory_order_acquire);
+					if (seq != pos + k + 1) break;
+					k++;
+				}
+				if (!k) {
+					// empty, or another consumer moved on
+					size_t seq = m_cells[pos & m_mask].seq.load(std::memory_order_acquire);
+					if (intptr_t(seq - (pos + 1)) < 0) return 0;
+					pos = m_pop_pos.load(std::memory_order_relaxed);
+					continue;
+				}
+				if (m_pop_pos.compare_exchange_weak(pos, pos + k, std::memory_order_relaxed)) return k;
+			}
+		}
+
+		void publishPush(size_t pos) noexcept {
+			m_cells[pos & m_mask].seq.store(pos + 1, std::memory_order_release);
+		}
+
+		void publishPop(size_t pos) noexcept {
+			m_cells[pos & m_mask].seq.store(pos + m_mask + 1, std::memory_order_release);
+		}
+
+		// move out of a claimed full cell and release it
+		template <typename OutT>
+		void take(size_t pos, OutT &&out) {
+			cell &c = m_cells[pos & m_mask];
+			out = std::move(*c.get());
+			c.get()->~T();
+			publishPop(pos);
+		}
+
+	public:
+		explicit mpmc_ring(size_t capacity) :
+			m_mask(detail::ring_capacity(capacity) - 1),
+			m_cells(new cell[m_mask + 1])
+		{
+			for (size_t i = 0; i <= m_mask; i++) {
+				m_cells[i].seq.store(i, std::memory_order_relaxed);
+			}
+		}
+
+		size_t capacity() const noexcept {
+			return m_mask + 1;
+		}
+
+		// approximate when other threads are pushing or popping
+		size_t size() const noexcept {
+			size_t pop = m_pop_pos.load(std::memory_order_relaxed);
+			size_t push = m_push_pos.load(std::memory_order_relaxed);
+			return intptr_t(push - pop) > 0 ? std::min(push - pop, capacity()) : 0;
+		}
+
+		bool empty() const noexcept {
+			return size() == 0;
+		}
+
+		// wake all blocked threads, which throw interruption
+		void interrupt() {
+			m_parking.interrupt();
+		}
+
+		// returns false if full
+		template <typename ...ArgTs>
+		bool try_emplace(ArgTs &&...args) {
+			size_t pos;
+			if (!claimPush(1, pos)) return false;
+			new (m_cells[pos & m_mask].get()) T(std::forward<ArgTs>(args)...);
+			publishPush(pos);
+			m_parking.wakePop();
+			return true;
+		}
+
+		bool try_push(const T &value) {
+			return try_emplace(value);
+		}
+
+		bool try_push(T &&value) {
+			return try_emplace(std::move(value));
+		}
+
+		// push up to n elements from first; returns the number pushed
+		template <typename InputIt>
+		size_t try_push_n(InputIt first, size_t n) {
+			size_t pushed = 0;
+			while (pushed < n) {
+				size_t pos;
+				size_t k = claimPush(n - pushed, pos);
+				if (!k) break;
+				for (size_t i = 0; i < k; i++, ++first) {
+					new (m_cells[(pos + i) & m_mask].get()) T(*first);
+					publishPush(pos + i);
+				}
+				pushed += k;
+			}
+			if (pushed) m_parking.wakePop(pushed > 1);
+			return pushed;
+		}
+
+		// returns false if empty
+		bool try_pop(T &ret) {
+			size_t pos;
+			if (!claimPop(1, pos)) return false;
+			take(pos, ret);
+			m_parking.wakePush();
+			return true;
+		}
+
+		// pop up to n elements to out; returns the number popped
+		template <typename OutputIt>
+		size_t try_pop_n(OutputIt out, size_t n) {
+			size_t popped = 0;
+			while (popped < n) {
+				size_t pos;
+				size_t k = claimPop(n - popped, pos);
+				if (!k) break;
+				for (size_t i = 0; i < k; i++, ++out) {
+					take(pos + i, *out);
+				}
+				popped += k;
+			}
+			if (popped) m_parking.wakePush(popped > 1);
+			return popped;
+		}
+
+		// push, blocking while full
+		template <typename ...ArgTs>
+		void emplace(ArgTs &&...args) {
+			while (!try_emplace(std::forward<ArgTs>(args)...)) {
+				m_parking.parkPush([&]() { return size() < capacity(); });
+			}
+		}
+
+		void push(const T &value) {
+			emplace(value);
+		}
+
+		void push(T &&value) {
+			emplace(std::move(value));
+		}
+
+		// push all n elements from first, blocking while full
+		template <typename ForwardIt>
+		void push_n(ForwardIt first, size_t n) {
+			while (n) {
+				size_t k = try_push_n(first, n);
+				std::advance(first, k);
+				n -= k;
+				if (n) m_parking.parkPush([&]() { return size() < capacity(); });
+			}
+		}
+
+		// pop, blocking while empty
+		T pop() {
+			while (true) {
+				size_t pos;
+				if (claimPop(1, pos)) {
+					cell &c = m_cells[pos & m_mask];
+					T ret(std::move(*c.get()));
+					c.get()->~T();
+					publishPop(pos);
+					m_parking.wakePush();
+					return ret;
+				}
+				m_parking.parkPop([&]() { return !empty(); });
+			}
+		}
+
+		// pop at least 1 and up to n elements to out, blocking while empty; returns the number popped
+		template <typename OutputIt>
+		size_t pop_n(OutputIt out, size_t n) {
+			if (!n) return 0;
+			while (true) {
+				if (size_t k = try_pop_n(out, n)) return k;
+				m_parking.parkPop([&]() { return !empty(); });
+			}
+		}
+
+		~mpmc_ring() {
+			size_t pos = m_pop_pos.load(std::memory_order_relaxed);
+			const size_t end = m_push_pos.load(std::memory_order_relaxed);
+			for (; pos != end; pos++) {
+				cell &c = m_cells[pos & m_mask];
+				if (c.seq.load(std::memory_order_acquire) == pos + 1) c.get()->~T();
+			}
+		}
+	};
+
+	// bounded single-producer single-consumer ring queue.
+	// only one thread may push and only one thread may pop at a time.
+	// capacity is rounded up to a power of 2. try_ operations never block; the others block
+	// while the ring is full (push) or empty (pop), and throw interruption if interrupted.
+	// T's constructors must not throw.
+	template <typename T>
+	class spsc_ring : private Uncopyable {
+	private:
+		static constexpr size_t cache_line = 64;
+
+		struct slot {
+			alignas(T) unsigned char storage[sizeof(T)];
+
+			T * get() noexcept {
+				return reinterpret_cast<T *>(storage);
+			}
+		};
+
+		const size_t m_mask;
+		std::unique_ptr<slot[]> m_slots;
+		detail::ring_parking m_parking;
+
+		// consumer position, and the consumer's last view of the producer position
+		alignas(cache_line) std::atomic<size_t> m_pop_pos { 0 };
+		size_t m_push_cache = 0;
+		// producer position, and the producer's last view of the consumer position
+		alignas(cache_line) std::atomic<size_t> m_push_pos { 0 };
+		size_t m_pop_cache = 0;
+		char m_pad[cache_line - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+
+		// free slots for the producer, up to n
+		size_t pushable(size_t pos, size_t n) {
+			size_t avail = capacity() - (pos - m_pop_cache);
+			if (avail < n) {
+				m_pop_cache = m_pop_pos.load(std::memory_order_acquire);
+				avail = capacity() - (pos - m_pop_cache);
+			}
+			return std::min(avail, n);
+		}
+
+		// full slots for the consumer, up to n
+		size_t poppable(size_t pos, size_t n) {
+			size_t avail = m_push_cache - pos;
+			if (avail < n) {
+				m_push_cache = m_push_pos.load(std::memory_order_acquire);
+				avail = m_push_cache - pos;
+			}
+			return std::min(avail, n);
+		}
+
+	public:
+		explicit spsc_ring(size_t capacity) :
+			m_mask(detail::ring_capacity(capacity) - 1),
+			m_slots(new slot[m_mask + 1])
+		{ }
+
+		size_t capacity() const noexcept {
+			return m_mask + 1;
+		}
+
+		// exact only when called by the producer or consumer
+		size_t size() const noexcept {
+			return m_push_pos.load(std::memory_order_acquire) - m_pop_pos.load(std::memory_order_acquire);
+		}
+
+		bool empty() const noexcept {
+			return size() == 0;
+		}
+
+		// wake all blocked threads, which throw interruption
+		void interrupt() {
+			m_parking.interrupt();
+		}
+
+		// returns false if full
+		template <typename ...ArgTs>
+		bool try_emplace(ArgTs &&...args) {
+			size_t pos = m_push_pos.load(std::memory_order_relaxed);
+			if (!pushable(pos, 1)) return false;
+			new (m_slots[pos & m_mask].get()) T(std::forward<ArgTs>(args)...);
+			m_push_pos.store(pos + 1, std::memory_order_release);
+			m_parking.wakePop();
+			return true;
+		}
+
+		bool try_push(const T &value) {
+			return try_emplace(value);
+		}
+
+		bool try_push(T &&value) {
+			return try_emplace(std::move(value));
+		}
+
+		// push up to n elements from first; returns the number pushed
+		template <typename InputIt>
+		size_t try_push_n(InputIt first, size_t n) {
+			size_t pos = m_push_pos.load(std::memory_order_relaxed);
+			size_t k = pushable(pos, n);
+			if (!k) return 0;
+			for (size_t i = 0; i < k; i++, ++first) {
+				new (m_slots[(pos + i) & m_mask].get()) T(*first);
+			}
+			m_push_pos.store(pos + k, std::memory_order_release);
+			m_parking.wakePop();
+			return k;
+		}
+
+		// returns false if empty
+		bool try_pop(T &ret) {
+			return try_pop_n(&ret, 1);
+		}
+
+		// pop up to n elements to out; returns the number popped
+		template <typename OutputIt>
+		size_t try_pop_n(OutputIt out, size_t n) {
+			size_t pos = m_pop_pos.load(std::memory_order_relaxed);
+			size_t k = poppable(pos, n);
+			if (!k) return 0;
+			for (size_t i = 0; i < k; i++, ++out) {
+				T *p = m_slots[(pos + i) & m_mask].get();
+				*out = std::move(*p);
+				p->~T();
+			}
+			m_pop_pos.store(pos + k, std::memory_order_release);
+			m_parking.wakePush();
+			return k;
+		}
+
+		// push, blocking while full
+		template <typename ...ArgTs>
+		void emplace(ArgTs &&...args) {
+			while (!try_emplace(std::forward<ArgTs>(args)...)) {
+				m_parking.parkPush([&]() { return size() < capacity(); });
+			}
+		}
+
+		void push(const T &value) {
+			emplace(value);
+		}
+
+		void push(T &&value) {
+			emplace(std::move(value));
+		}
+
+		// push all n elements from first, blocking while full
+		template <typename ForwardIt>
+		void push_n(ForwardIt first, size_t n) {
+			while (n) {
+				size_t k = try_push_n(first, n);
+				std::advance(first, k);
+				n -= k;
+				if (n) m_parking.parkPush([&]() { return size() < capacity(); });
+			}
+		}
+
+		// pop, blocking while empty
+		T pop() {
+			while (true) {
+				size_t pos = m_pop_pos.load(std::memory_order_relaxed);
+				if (poppable(pos, 1)) {
+					T *p = m_slots[pos & m_mask].get();
+					T ret(std::move(*p));
+					p->~T();
+					m_pop_pos.store(pos + 1, std::memory_order_release);
+					m_parking.wakePush();
+					return ret;
+				}
+				m_parking.parkPop([&]() { return !empty(); });
+			}
+		}
+
+		// pop at least 1 and up to n elements to out, blocking while empty; returns the number popped
+		template <typename OutputIt>
+		size_t pop_n(OutputIt out, size_t n) {
+			if (!n) return 0;
+			while (true) {
+				if (size_t k = try_pop_n(out, n)) return k;
+				m_parking.parkPop([&]() { return !empty(); });
+			}
+		}
+
+		~spsc_ring() {
+			size_t pos = m_pop_pos.load(std::memory_order_relaxed);
+			const size_t end = m_push_pos.load(std::memory_order_acquire);
+			for (; pos != end; pos++) {
+				m_slots[pos & m_mask].get()->~T();
+			}
+		}
+	};
+
 }
 
 namespace {
@@ -0,0 +1,427 @@
+/*
+ * GECom Coroutine Tasks Header
+ *
+ * Stackless coroutine tasks on the task engine. A suspended coroutine holds
+ * no thread; it is resumed as a new task on the background or affinitized
+ * scheduler when the thing it awaits is ready. Coroutine frames are allocated
+ * from the task memory pool.
+ *
+ * Requires C++20 coroutine support; configure with GECOM_CXX20=ON.
+ *
+ * Awaitable inside an async::task:
+ *  - co_await task<T>               run another task inline, resuming when it completes
+ *  - co_await future<T>             resume when the future is ready
+ *  - co_await reschedule(deadline)  resubmit this task, letting more urgent tasks run first
+ *  - co_await resume_on(thread)     continue on a (different) thread's affinitized scheduler
+ *  - co_await sleep_until(time)     resume no earlier than the specified time
+ *  - co_await sleep_for(duration)   resume no earlier than after the specified duration
+ */
+
+#ifndef GECOM_COROUTINE_HPP
+#define GECOM_COROUTINE_HPP
+
+#if !defined(__cpp_impl_coroutine)
+#error "gecom/Coroutine.hpp requires C++20 coroutine support (configure with GECOM_CXX20=ON)"
+#endif
+
+#include <cassert>
+#include <cstddef>
+#include <exception>
+#include <coroutine>
+#include <optional>
+#include <utility>
+#include <type_traits>
+
+#include "Concurrent.hpp"
+#include "Future.hpp"
+
+namespace gecom {
+
+	namespace async {
+
+		template <typename T = void>
+		class task;
+
+		namespace detail {
+
+			// where a coroutine is resumed after it suspends
+			struct coroutine_context {
+				std::thread::id affinity;
+				clock::time_point deadline = clock::now();
+			};
+
+			// coroutine frames come from the task memory pool
+			struct pooled_frame {
+				static void * operator new(size_t size) {
+					return pool_allocate(size);
+				}
+
+				static void operator delete(void *p, size_t size) noexcept {
+					pool_deallocate(p, size);
+				}
+			};
+
+			// submit a task that resumes a coroutine
+			inline void schedule_resume(std::coroutine_handle<> h, const coroutine_context &ctx) {
+				invoke(ctx.affinity, ctx.deadline, make_callable_runnable([h]() { h.resume(); }));
+			}
+
+			// submit a task that resumes a coroutine at a given time
+			inline void schedule_resume_at(std::coroutine_handle<> h, const coroutine_context &ctx, clock::time_point due) {
+				invokeAt(due, ctx.affinity, ctx.deadline, make_callable_runnable([h]() { h.resume(); }));
+			}
+
+			class task_promise_base : public coroutine_context, public pooled_frame {
+			private:
+				std::coroutine_handle<> m_continuation;
+				std::exception_ptr m_exception;
+
+				// resume whoever awaited this task, if anyone
+				struct final_awaiter {
+					bool await_ready() noexcept {
+						return false;
+					}
+
+					template <typename PromiseT>
+					std::coroutine_handle<> await_suspend(std::coroutine_handle<PromiseT> h) noexcept {
+						auto c = h.promise().m_continuation;
+						return c ? c : std::noop_coroutine();
+					}
+
+					void await_resume() noexcept { }
+				};
+
+			protected:
+				void rethrow() const {
+					if (m_exception) std::rethrow_exception(m_exception);
+				}
+
+			public:
+				// tasks are lazy; they start when awaited or spawned
+				std::suspend_always initial_suspend() noexcept {
+					return { };
+				}
+
+				final_awaiter final_suspend() noexcept {
+					return { };
+				}
+
+				void unhandled_exception() noexcept {
+					m_exception = std::current_exception();
+				}
+
+				void continuation(std::coroutine_handle<> h) noexcept {
+					m_continuation = h;
+				}
+			};
+
+			template <typename T>
+			class task_promise : public task_promise_base {
+			private:
+				std::optional<T> m_value;
+
+			public:
+				task<T> get_return_object() noexcept;
+
+				template <typename U>
+				void return_value(U &&u) {
+					m_value.emplace(std::forward<U>(u));
+				}
+
+				T result() {
+					rethrow();
+					return std::move(*m_value);
+				}
+			};
+
+			template <>
+			class task_promise<void> : public task_promise_base {
+			public:
+				task<void> get_return_object() noexcept;
+
+				void return_void() noexcept { }
+
+				void result() {
+					rethrow();
+				}
+			};
+
+			// fire-and-forget coroutine that destroys itself on completion
+			struct detached_task {
+				struct promise_type : coroutine_context, pooled_frame {
+					detached_task get_return_object() noexcept {
+						return { std::coroutine_handle<promise_type>::from_promise(*this) };
+					}
+
+					std::suspend_always initial_suspend() noexcept {
+						return { };
+					}
+
+					std::suspend_never final_suspend() noexcept {
+						return { };
+					}
+
+					void return_void() noexcept { }
+
+					void unhandled_exception() noexcept {
+						std::terminate();
+					}
+				};
+
+				std::coroutine_handle<promise_type> handle;
+			};
+
+			// start an awaited task by symmetric transfer, resuming the awaiting coroutine when it completes
+			template <typename T>
+			struct task_awaiter {
+				std::coroutine_handle<task_promise<T>> h;
+
+				bool await_ready() noexcept {
+					return false;
+				}
+
+				template <typename PromiseT>
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<PromiseT> awaiting) noexcept {
+					// inherit the awaiting coroutine's scheduling context
+					auto &p = h.promise();
+					static_cast<coroutine_context &>(p) = awaiting.promise();
+					p.continuation(awaiting);
+					return h;
+				}
+
+				T await_resume() {
+					return h.promise().result();
+				}
+			};
+
+		}
+
+		// lazily-started coroutine task producing a T.
+		// awaiting a task from another task runs it on the awaiting task's scheduler;
+		// spawn() runs it as a root task and returns a future for its result.
+		template <typename T>
+		class task {
+		public:
+			using promise_type = detail::task_promise<T>;
+			using handle_type = std::coroutine_handle<promise_type>;
+
+		private:
+			handle_type m_handle;
+
+		public:
+			task() { }
+
+			explicit task(handle_type handle_) : m_handle(handle_) { }
+
+			task(const task &) = delete;
+			task & operator=(const task &) = delete;
+
+			task(task &&other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) { }
+
+			task & operator=(task &&other) noexcept {
+				if (this != &other) {
+					if (m_handle) m_handle.destroy();
+					m_handle = std::exchange(other.m_handle, nullptr);
+				}
+				return *this;
+			}
+
+			bool valid() const noexcept {
+				return bool(m_handle);
+			}
+
+			detail::task_awaiter<T> operator co_await() && noexcept {
+				assert(m_handle);
+				return { m_handle };
+			}
+
+			~task() {
+				if (m_handle) m_handle.destroy();
+			}
+		};
+
+		namespace detail {
+
+			template <typename T>
+			inline task<T> task_promise<T>::get_return_object() noexcept {
+				return task<T>(std::coroutine_handle<task_promise<T>>::from_promise(*this));
+			}
+
+			inline task<void> task_promise<void>::get_return_object() noexcept {
+				return task<void>(std::coroutine_handle<task_promise<void>>::from_promise(*this));
+			}
+
+			template <typename T>
+			inline detached_task run_task(task<T> t, promise<T> p) {
+				try {
+					if constexpr (std::is_void_v<T>) {
+						co_await std::move(t);
+						p.set_value();
+					} else {
+						p.set_value(co_await std::move(t));
+					}
+				} catch (...) {
+					p.set_exception(std::current_exception());
+				}
+			}
+
+		}
+
+		// run a coroutine task on an affinitized scheduler (absolute deadline).
+		// the deadline applies each time the task is resumed unless changed with reschedule().
+		template <typename T>
+		inline future<T> spawn(std::thread::id affinity, clock::time_point deadline, task<T> t) {
+			promise<T> p;
+			auto f = p.get_future();
+			auto root = detail::run_task(std::move(t), std::move(p));
+			root.handle.promise().affinity = affinity;
+			root.handle.promise().deadline = deadline;
+			detail::schedule_resume(root.handle, root.handle.promise());
+			return f;
+		}
+
+		// run a coroutine task on an affinitized scheduler (relative deadline)
+		template <typename T>
+		inline future<T> spawn(std::thread::id affinity, clock::duration deadline, task<T> t) {
+			return spawn(std::move(affinity), clock::now() + deadline, std::move(t));
+		}
+
+		// run a coroutine task on the background scheduler (absolute deadline)
+		template <typename T>
+		inline future<T> spawn(clock::time_point deadline, task<T> t) {
+			return spawn(std::thread::id(), deadline, std::move(t));
+		}
+
+		// run a coroutine task on the background scheduler (relative deadline)
+		template <typename T>
+		inline future<T> spawn(clock::duration deadline, task<T> t) {
+			return spawn(std::thread::id(), clock::now() + deadline, std::move(t));
+		}
+
+		namespace detail {
+
+			// resubmit the awaiting coroutine, optionally with a new deadline
+			struct reschedule_awaiter {
+				bool set_deadline;
+				clock::time_point deadline;
+
+				bool await_ready() noexcept {
+					return false;
+				}
+
+				template <typename PromiseT>
+				void await_suspend(std::coroutine_handle<PromiseT> h) {
+					if (set_deadline) h.promise().deadline = deadline;
+					schedule_resume(h, h.promise());
+				}
+
+				void await_resume() noexcept { }
+			};
+
+			// move the awaiting coroutine to another scheduler
+			struct resume_on_awaiter {
+				std::thread::id affinity;
+
+				bool await_ready() noexcept {
+					return false;
+				}
+
+				template <typename PromiseT>
+				bool await_suspend(std::coroutine_handle<PromiseT> h) {
+					auto &p = h.promise();
+					const bool same = p.affinity == affinity;
+					p.affinity = affinity;
+					// don't suspend if already running where we've been asked to
+					if (same && (affinity == std::thread::id() || affinity == std::this_thread::get_id())) return false;
+					schedule_resume(h, p);
+					return true;
+				}
+
+				void await_resume() noexcept { }
+			};
+
+			// resume the awaiting coroutine at a given time
+			struct sleep_awaiter {
+				clock::time_point time;
+
+				bool await_ready() noexcept {
+					return clock::now() >= time;
+				}
+
+				template <typename PromiseT>
+				void await_suspend(std::coroutine_handle<PromiseT> h) {
+					schedule_resume_at(h, h.promise(), time);
+				}
+
+				void await_resume() noexcept { }
+			};
+
+			// resume the awaiting coroutine when a future is ready
+			template <typename T>
+			struct future_awaiter {
+				future<T> f;
+
+				bool await_ready() noexcept {
+					return f.ready();
+				}
+
+				template <typename PromiseT>
+				void await_suspend(std::coroutine_handle<PromiseT> h) {
+					auto &p = h.promise();
+					// then() consumes the future; the continuation hands it back before resuming
+					f.then(p.affinity, p.deadline, [this, h](future<T> g) {
+						f = std::move(g);
+						h.resume();
+					});
+				}
+
+				T await_resume() {
+					return f.get();
+				}
+			};
+
+		}
+
+		// suspend the current task and resubmit it with a new deadline,
+		// allowing tasks with earlier deadlines to run first. frees the current thread.
+		inline detail::reschedule_awaiter reschedule(clock::time_point deadline) noexcept {
+			return { true, deadline };
+		}
+
+		// suspend the current task and resubmit it with a new relative deadline
+		inline detail::reschedule_awaiter reschedule(clock::duration deadline) noexcept {
+			return { true, clock::now() + deadline };
+		}
+
+		// suspend the current task and resubmit it with its current deadline
+		inline detail::reschedule_awaiter reschedule() noexcept {
+			return { false, clock::time_point() };
+		}
+
+		// continue the current task on a thread's affinitized scheduler (or the background
+		// scheduler for a default-constructed thread id). does not suspend if already there.
+		inline detail::resume_on_awaiter resume_on(std::thread::id affinity) noexcept {
+			return { affinity };
+		}
+
+		// suspend the current task until the specified time; no thread is held while sleeping
+		inline detail::sleep_awaiter sleep_until(clock::time_point time) noexcept {
+			return { time };
+		}
+
+		// suspend the current task for the specified duration; no thread is held while sleeping
+		inline detail::sleep_awaiter sleep_for(clock::duration d) noexcept {
+			return { clock::now() + d };
+		}
+
+		// await a future; the task is resumed on its scheduler once the future is ready
+		template <typename T>
+		inline detail::future_awaiter<T> operator co_await(future<T> &&f) noexcept {
+			return { std::move(f) };
+		}
+
+	}
+
+}
+
+#endif // GECOM_COROUTINE_HPP
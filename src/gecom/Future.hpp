@@ -0,0 +1,665 @@
+/*
+ * GECom Continuation Futures Header
+ *
+ * Futures that can schedule dependent work onto the task engine without
+ * blocking a thread. A continuation attached with then() is submitted as a
+ * task (background or affinitized) when the future becomes ready; when_all()
+ * and when_any() combine futures without any scheduler hop.
+ */
+
+#ifndef GECOM_FUTURE_HPP
+#define GECOM_FUTURE_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <new>
+#include <atomic>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <condition_variable>
+#include <iterator>
+#include <tuple>
+#include <array>
+#include <vector>
+#include <utility>
+#include <type_traits>
+
+#include "Concurrent.hpp"
+
+namespace gecom {
+
+	namespace async {
+
+		template <typename T>
+		class future;
+
+		template <typename T>
+		class promise;
+
+		namespace detail {
+
+			// work to run when a future becomes ready
+			struct continuation {
+				runnable_ptr runnable;
+				std::thread::id affinity;
+				clock::time_point deadline;
+				// run on the completing thread instead of submitting a task
+				bool immediate = false;
+
+				// run or submit, then destroy the continuation
+				static void dispatch(continuation *c) {
+					runnable_ptr r = std::move(c->runnable);
+					const bool immediate = c->immediate;
+					const std::thread::id affinity = c->affinity;
+					const clock::time_point deadline = c->deadline;
+					pool_delete(c);
+					if (immediate) {
+						r->run();
+					} else {
+						detail::invoke(affinity, deadline, std::move(r));
+					}
+				}
+			};
+
+			template <typename FunT>
+			inline continuation * make_continuation(std::thread::id affinity, clock::time_point deadline, FunT &&fun) {
+				runnable_ptr r = make_callable_runnable(std::forward<FunT>(fun));
+				continuation *c = pool_new<continuation>();
+				c->runnable = std::move(r);
+				c->affinity = affinity;
+				c->deadline = deadline;
+				return c;
+			}
+
+			// make a continuation that runs on the completing thread; must not throw
+			template <typename FunT>
+			inline continuation * make_immediate_continuation(FunT &&fun) {
+				continuation *c = make_continuation(std::thread::id(), clock::time_point(), std::forward<FunT>(fun));
+				c->immediate = true;
+				return c;
+			}
+
+			// shared state between a promise and a future.
+			// completion and continuation attachment are lock-free;
+			// the mutex is only used to block threads waiting on the result.
+			class future_state_base : private Uncopyable {
+			private:
+				// null: pending; self: completed; other: pending with continuation attached
+				std::atomic<continuation *> m_cont { nullptr };
+				std::atomic<unsigned> m_waiters { 0 };
+				std::mutex m_mutex;
+				std::condition_variable m_cond;
+				std::exception_ptr m_exception;
+
+				continuation * completedMarker() const noexcept {
+					return reinterpret_cast<continuation *>(const_cast<future_state_base *>(this));
+				}
+
+			protected:
+				// publish the result; call after storing the value or exception
+				void complete() {
+					continuation *c = m_cont.exchange(completedMarker());
+					assert(c != completedMarker() && "future state already completed");
+					if (m_waiters) {
+						// lock so a waiter cannot miss the notification between its test and its wait
+						std::unique_lock<std::mutex> lock(m_mutex);
+						m_cond.notify_all();
+					}
+					if (c) continuation::dispatch(c);
+				}
+
+				void rethrow() const {
+					if (m_exception) std::rethrow_exception(m_exception);
+				}
+
+			public:
+				future_state_base() { }
+
+				bool ready() const noexcept {
+					return m_cont.load() == completedMarker();
+				}
+
+				void setException(std::exception_ptr e) {
+					m_exception = std::move(e);
+					complete();
+				}
+
+				// attach the (only) continuation; dispatches immediately if already complete
+				void attach(continuation *c) {
+					continuation *expected = nullptr;
+					if (!m_cont.compare_exchange_strong(expected, c)) {
+						if (expected != completedMarker()) {
+							pool_delete(c);
+							throw std::logic_error("future already has a continuation");
+						}
+						continuation::dispatch(c);
+					}
+				}
+
+				// remove a continuation that has not been dispatched, so another can be attached.
+				// does nothing if the state has completed (the continuation is then being or has been run).
+				void detach(continuation *c) noexcept {
+					if (m_cont.compare_exchange_strong(c, nullptr)) pool_delete(c);
+				}
+
+				void wait() {
+					// in deterministic mode the result may depend on tasks only this thread can run
+					while (!ready() && assist()) { }
+					if (ready()) return;
+					std::unique_lock<std::mutex> lock(m_mutex);
+					m_waiters++;
+					while (!ready()) {
+						m_cond.wait(lock);
+					}
+					m_waiters--;
+				}
+
+				// returns true if the state became ready before the timeout
+				bool waitUntil(clock::time_point time) {
+					while (!ready() && clock::now() < time && assist()) { }
+					if (ready()) return true;
+					std::unique_lock<std::mutex> lock(m_mutex);
+					m_waiters++;
+					while (!ready() && clock::now() < time) {
+						m_cond.wait_until(lock, time);
+					}
+					m_waiters--;
+					return ready();
+				}
+
+				virtual ~future_state_base() {
+					continuation *c = m_cont.load();
+					if (c && c != completedMarker()) pool_delete(c);
+				}
+			};
+
+			template <typename T>
+			class future_state : public future_state_base {
+			private:
+				alignas(T) unsigned char m_storage[sizeof(T)];
+				bool m_has_value = false;
+
+				T & value() noexcept {
+					return *reinterpret_cast<T *>(m_storage);
+				}
+
+			public:
+				template <typename ...ArgTR>
+				void setValue(ArgTR &&...args) {
+					new (m_storage) T(std::forward<ArgTR>(args)...);
+					m_has_value = true;
+					complete();
+				}
+
+				// wait, then move the value out (or throw the stored exception)
+				T take() {
+					wait();
+					rethrow();
+					return std::move(value());
+				}
+
+				virtual ~future_state() {
+					if (m_has_value) value().~T();
+				}
+			};
+
+			template <>
+			class future_state<void> : public future_state_base {
+			public:
+				void setValue() {
+					complete();
+				}
+
+				void take() {
+					wait();
+					rethrow();
+				}
+			};
+
+			template <typename T>
+			using future_state_ptr = std::shared_ptr<future_state<T>>;
+
+			template <typename T>
+			inline future_state_ptr<T> make_future_state() {
+				return std::allocate_shared<future_state<T>>(pool_allocator<future_state<T>>());
+			}
+
+			// access to future internals for the combinators
+			struct future_access {
+				template <typename T>
+				static void attach(future<T> &f, continuation *c) {
+					assert(f.valid());
+					f.m_state->attach(c);
+				}
+
+				template <typename T>
+				static void detach(future<T> &f, continuation *c) noexcept {
+					f.m_state->detach(c);
+				}
+			};
+
+			// set a promise from the result of a function, capturing any exception
+			template <typename T, typename FunT>
+			void fulfil(promise<T> &p, FunT &&fun);
+
+			template <typename FunT>
+			void fulfil(promise<void> &p, FunT &&fun);
+
+		}
+
+		// result of a future; supports continuations.
+		// move-only, and like std::future, get() and then() consume it.
+		template <typename T>
+		class future {
+			static_assert(!std::is_reference<T>::value, "reference futures not supported");
+
+			template <typename>
+			friend class promise;
+
+			friend struct detail::future_access;
+
+		private:
+			detail::future_state_ptr<T> m_state;
+
+			explicit future(detail::future_state_ptr<T> state_) : m_state(std::move(state_)) { }
+
+		public:
+			using value_type = T;
+
+			future() { }
+
+			future(const future &) = delete;
+			future & operator=(const future &) = delete;
+
+			future(future &&) = default;
+			future & operator=(future &&) = default;
+
+			// test if this future refers to a shared state
+			bool valid() const noexcept {
+				return bool(m_state);
+			}
+
+			// test if the result is available
+			bool ready() const noexcept {
+				return m_state && m_state->ready();
+			}
+
+			// block until the result is available
+			void wait() const {
+				assert(valid());
+				m_state->wait();
+			}
+
+			// block until the result is available or the timeout lapses; returns true if ready
+			bool wait_until(clock::time_point time) const {
+				assert(valid());
+				return m_state->waitUntil(time);
+			}
+
+			// block until the result is available or the timeout lapses; returns true if ready
+			bool wait_for(clock::duration timeout) const {
+				return wait_until(clock::now() + timeout);
+			}
+
+			// block until the result is available, then return it (or throw the stored exception).
+			// invalidates this future.
+			T get() {
+				assert(valid());
+				auto state = std::move(m_state);
+				return state->take();
+			}
+
+			// run a task (affinitized; absolute deadline) with this future once it is ready.
+			// returns a future for the task's result. invalidates this future.
+			template <typename FunT>
+			auto then(std::thread::id affinity, clock::time_point deadline, FunT &&fun) -> future<decltype(fun(std::declval<future>()))> {
+				using result_t = decltype(fun(std::declval<future>()));
+				assert(valid());
+				auto state = m_state;
+				promise<result_t> p;
+				auto f = p.get_future();
+				state->attach(detail::make_continuation(
+					std::move(affinity),
+					std::move(deadline),
+					[p = std::move(p), fun = std::decay_t<FunT>(std::forward<FunT>(fun)), self = std::move(*this)]() mutable {
+						detail::fulfil(p, [&]() -> decltype(auto) { return fun(std::move(self)); });
+					}
+				));
+				return f;
+			}
+
+			// run a task (affinitized; relative deadline) with this future once it is ready
+			template <typename FunT>
+			auto then(std::thread::id affinity, clock::duration deadline, FunT &&fun) {
+				return then(std::move(affinity), clock::now() + deadline, std::forward<FunT>(fun));
+			}
+
+			// run a background task (absolute deadline) with this future once it is ready
+			template <typename FunT>
+			auto then(clock::time_point deadline, FunT &&fun) {
+				return then(std::thread::id(), std::move(deadline), std::forward<FunT>(fun));
+			}
+
+			// run a background task (relative deadline) with this future once it is ready
+			template <typename FunT>
+			auto then(clock::duration deadline, FunT &&fun) {
+				return then(std::thread::id(), clock::now() + deadline, std::forward<FunT>(fun));
+			}
+
+			// run a background task (immediate deadline) with this future once it is ready
+			template <typename FunT>
+			auto then(FunT &&fun) {
+				return then(std::thread::id(), clock::now(), std::forward<FunT>(fun));
+			}
+		};
+
+		// producer side of a future
+		template <typename T>
+		class promise {
+		private:
+			detail::future_state_ptr<T> m_state;
+			bool m_retrieved = false;
+			bool m_satisfied = false;
+
+			void satisfy() {
+				if (!m_state) throw std::future_error(std::future_errc::no_state);
+				if (m_satisfied) throw std::future_error(std::future_errc::promise_already_satisfied);
+				m_satisfied = true;
+			}
+
+		public:
+			promise() : m_state(detail::make_future_state<T>()) { }
+
+			promise(const promise &) = delete;
+			promise & operator=(const promise &) = delete;
+
+			promise(promise &&other) noexcept :
+				m_state(std::move(other.m_state)), m_retrieved(other.m_retrieved), m_satisfied(other.m_satisfied)
+			{ }
+
+			promise & operator=(promise &&other) noexcept {
+				// break our current promise (if any) via the temporary's destructor
+				promise tmp(std::move(other));
+				swap(tmp);
+				return *this;
+			}
+
+			void swap(promise &other) noexcept {
+				using std::swap;
+				swap(m_state, other.m_state);
+				swap(m_retrieved, other.m_retrieved);
+				swap(m_satisfied, other.m_satisfied);
+			}
+
+			future<T> get_future() {
+				if (!m_state) throw std::future_error(std::future_errc::no_state);
+				if (m_retrieved) throw std::future_error(std::future_errc::future_already_retrieved);
+				m_retrieved = true;
+				return future<T>(m_state);
+			}
+
+			// set the result; takes no arguments for promise<void>
+			template <typename ...ArgTR>
+			void set_value(ArgTR &&...args) {
+				satisfy();
+				m_state->setValue(std::forward<ArgTR>(args)...);
+			}
+
+			void set_exception(std::exception_ptr e) {
+				satisfy();
+				m_state->setException(std::move(e));
+			}
+
+			~promise() {
+				if (m_state && !m_satisfied) {
+					m_state->setException(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+				}
+			}
+		};
+
+		namespace detail {
+
+			template <typename T, typename FunT>
+			void fulfil(promise<T> &p, FunT &&fun) {
+				try {
+					p.set_value(fun());
+				} catch (...) {
+					p.set_exception(std::current_exception());
+				}
+			}
+
+			template <typename FunT>
+			void fulfil(promise<void> &p, FunT &&fun) {
+				try {
+					fun();
+					p.set_value();
+				} catch (...) {
+					p.set_exception(std::current_exception());
+				}
+			}
+
+		}
+
+		template <typename T>
+		inline future<std::decay_t<T>> make_ready_future(T &&t) {
+			promise<std::decay_t<T>> p;
+			p.set_value(std::forward<T>(t));
+			return p.get_future();
+		}
+
+		inline future<void> make_ready_future() {
+			promise<void> p;
+			p.set_value();
+			return p.get_future();
+		}
+
+		template <typename T>
+		inline future<T> make_exceptional_future(std::exception_ptr e) {
+			promise<T> p;
+			p.set_exception(std::move(e));
+			return p.get_future();
+		}
+
+		// invoke an affinitized task (absolute deadline), returning a continuation-capable future
+		template <typename TaskFunT, typename ...ArgTR>
+		inline auto spawn(std::thread::id affinity, clock::time_point deadline, TaskFunT &&taskfun, ArgTR &&...args) -> future<decltype(taskfun(args...))> {
+			using result_t = decltype(taskfun(args...));
+			promise<result_t> p;
+			auto f = p.get_future();
+			detail::invoke(std::move(affinity), std::move(deadline), detail::make_callable_runnable(
+				[
+					p = std::move(p),
+					fun = std::decay_t<TaskFunT>(std::forward<TaskFunT>(taskfun)),
+					args = std::make_tuple(std::forward<ArgTR>(args)...)
+				]() mutable {
+					detail::fulfil(p, [&]() -> decltype(auto) { return util::call(std::move(fun), std::move(args)); });
+				}
+			));
+			return f;
+		}
+
+		// invoke an affinitized task (relative deadline), returning a continuation-capable future
+		template <typename TaskFunT, typename ...ArgTR>
+		inline auto spawn(std::thread::id affinity, clock::duration deadline, TaskFunT &&taskfun, ArgTR &&...args) -> future<decltype(taskfun(args...))> {
+			return spawn(std::move(affinity), clock::now() + deadline, std::forward<TaskFunT>(taskfun), std::forward<ArgTR>(args)...);
+		}
+
+		// invoke a background task (absolute deadline), returning a continuation-capable future
+		template <typename TaskFunT, typename ...ArgTR>
+		inline auto spawn(clock::time_point deadline, TaskFunT &&taskfun, ArgTR &&...args) -> future<decltype(taskfun(args...))> {
+			return spawn(std::thread::id(), std::move(deadline), std::forward<TaskFunT>(taskfun), std::forward<ArgTR>(args)...);
+		}
+
+		// invoke a background task (relative deadline), returning a continuation-capable future
+		template <typename TaskFunT, typename ...ArgTR>
+		inline auto spawn(clock::duration deadline, TaskFunT &&taskfun, ArgTR &&...args) -> future<decltype(taskfun(args...))> {
+			return spawn(clock::now() + deadline, std::forward<TaskFunT>(taskfun), std::forward<ArgTR>(args)...);
+		}
+
+		// invoke a task affinitized to the main thread (absolute deadline), returning a continuation-capable future
+		template <typename TaskFunT, typename ...ArgTR>
+		inline auto spawnMain(clock::time_point deadline, TaskFunT &&taskfun, ArgTR &&...args) -> future<decltype(taskfun(args...))> {
+			return spawn(mainThreadId(), std::move(deadline), std::forward<TaskFunT>(taskfun), std::forward<ArgTR>(args)...);
+		}
+
+		// invoke a task affinitized to the main thread (relative deadline), returning a continuation-capable future
+		template <typename TaskFunT, typename ...ArgTR>
+		inline auto spawnMain(clock::duration deadline, TaskFunT &&taskfun, ArgTR &&...args) -> future<decltype(taskfun(args...))> {
+			return spawnMain(clock::now() + deadline, std::forward<TaskFunT>(taskfun), std::forward<ArgTR>(args)...);
+		}
+
+		// result of when_any(): index of the first ready future (or -1 if there were none), and all the futures
+		template <typename SequenceT>
+		struct when_any_result {
+			size_t index = size_t(-1);
+			SequenceT futures;
+		};
+
+		// future that becomes ready when all futures in a range are ready
+		template <typename InputItT>
+		inline auto when_all(InputItT first, InputItT last) -> future<std::vector<typename std::iterator_traits<InputItT>::value_type>> {
+			using result_t = std::vector<typename std::iterator_traits<InputItT>::value_type>;
+			struct shared_t {
+				result_t futures;
+				promise<result_t> p;
+				// one extra count is held until all continuations are attached
+				std::atomic<size_t> remaining { 1 };
+
+				void release() {
+					if (--remaining == 0) p.set_value(std::move(futures));
+				}
+			};
+			auto s = std::allocate_shared<shared_t>(detail::pool_allocator<shared_t>());
+			s->futures.assign(std::make_move_iterator(first), std::make_move_iterator(last));
+			auto f = s->p.get_future();
+			s->remaining += s->futures.size();
+			for (auto &x : s->futures) {
+				detail::future_access::attach(x, detail::make_immediate_continuation([s]() { s->release(); }));
+			}
+			s->release();
+			return f;
+		}
+
+		namespace detail {
+
+			template <typename TupleT, typename FunT, size_t ...IR>
+			inline void for_each_future(TupleT &t, FunT &&fun, std::index_sequence<IR...>) {
+				int dummy[] { 0, (fun(std::get<IR>(t), IR), 0)... };
+				(void) dummy;
+			}
+
+		}
+
+		// future that becomes ready when all of the specified futures are ready
+		template <typename ...FutureTR>
+		inline auto when_all(FutureTR &&...futures) -> future<std::tuple<std::decay_t<FutureTR>...>> {
+			using result_t = std::tuple<std::decay_t<FutureTR>...>;
+			struct shared_t {
+				result_t futures;
+				promise<result_t> p;
+				std::atomic<size_t> remaining { sizeof...(FutureTR) + 1 };
+
+				shared_t(result_t futures_) : futures(std::move(futures_)) { }
+
+				void release() {
+					if (--remaining == 0) p.set_value(std::move(futures));
+				}
+			};
+			auto s = std::allocate_shared<shared_t>(detail::pool_allocator<shared_t>(), result_t(std::move(futures)...));
+			auto f = s->p.get_future();
+			detail::for_each_future(s->futures, [&s](auto &x, size_t) {
+				detail::future_access::attach(x, detail::make_immediate_continuation([s]() { s->release(); }));
+			}, std::index_sequence_for<FutureTR...>());
+			s->release();
+			return f;
+		}
+
+		// future that becomes ready when any future in a range is ready.
+		// the futures still pending in the result can be waited on or continued as usual.
+		template <typename InputItT>
+		inline auto when_any(InputItT first, InputItT last) -> future<when_any_result<std::vector<typename std::iterator_traits<InputItT>::value_type>>> {
+			using result_t = when_any_result<std::vector<typename std::iterator_traits<InputItT>::value_type>>;
+			struct shared_t {
+				result_t result;
+				promise<result_t> p;
+				std::atomic<size_t> winner { size_t(-1) };
+				// released once by the first ready future and once when all continuations are attached
+				std::atomic<int> gate { 2 };
+				// our continuation on each future
+				std::vector<detail::continuation *> conts;
+
+				void win(size_t i) {
+					size_t expected = size_t(-1);
+					if (winner.compare_exchange_strong(expected, i)) release();
+				}
+
+				void release() {
+					if (--gate == 0) {
+						result.index = winner;
+						// detach from the futures still pending so they can be continued again
+						for (size_t i = 0; i < conts.size(); i++) {
+							detail::future_access::detach(result.futures[i], conts[i]);
+						}
+						p.set_value(std::move(result));
+					}
+				}
+			};
+			auto s = std::allocate_shared<shared_t>(detail::pool_allocator<shared_t>());
+			s->result.futures.assign(std::make_move_iterator(first), std::make_move_iterator(last));
+			auto f = s->p.get_future();
+			if (s->result.futures.empty()) s->release();
+			s->conts.resize(s->result.futures.size());
+			for (size_t i = 0; i < s->result.futures.size(); i++) {
+				s->conts[i] = detail::make_immediate_continuation([s, i]() { s->win(i); });
+				detail::future_access::attach(s->result.futures[i], s->conts[i]);
+			}
+			s->release();
+			return f;
+		}
+
+		// future that becomes ready when any of the specified futures is ready
+		template <typename ...FutureTR>
+		inline auto when_any(FutureTR &&...futures) -> future<when_any_result<std::tuple<std::decay_t<FutureTR>...>>> {
+			using result_t = when_any_result<std::tuple<std::decay_t<FutureTR>...>>;
+			struct shared_t {
+				result_t result;
+				promise<result_t> p;
+				std::atomic<size_t> winner { size_t(-1) };
+				std::atomic<int> gate { 2 };
+				std::array<detail::continuation *, sizeof...(FutureTR)> conts;
+
+				void win(size_t i) {
+					size_t expected = size_t(-1);
+					if (winner.compare_exchange_strong(expected, i)) release();
+				}
+
+				void release() {
+					if (--gate == 0) {
+						result.index = winner;
+						detail::for_each_future(result.futures, [this](auto &x, size_t i) {
+							detail::future_access::detach(x, conts[i]);
+						}, std::index_sequence_for<FutureTR...>());
+						p.set_value(std::move(result));
+					}
+				}
+			};
+			auto s = std::allocate_shared<shared_t>(detail::pool_allocator<shared_t>());
+			s->result.futures = std::make_tuple(std::move(futures)...);
+			auto f = s->p.get_future();
+			if (sizeof...(FutureTR) == 0) s->release();
+			detail::for_each_future(s->result.futures, [&s](auto &x, size_t i) {
+				s->conts[i] = detail::make_immediate_continuation([s, i]() { s->win(i); });
+				detail::future_access::attach(x, s->conts[i]);
+			}, std::index_sequence_for<FutureTR...>());
+			s->release();
+			return f;
+		}
+
+	}
+
+}
+
+#endif // GECOM_FUTURE_HPP
@@ -7,8 +7,11 @@
 
 // Are we posix-ish?
 #ifdef GECOM_PLATFORM_POSIX
+#include <fcntl.h>
 #include <unistd.h>
 #include <time.h>
+#include <signal.h>
+#include <sys/mman.h>
 // Posix defines gmtime_r(), which is threadsafe
 #define GECOM_HAVE_GMTIME_R
 // Posix defines getpid()
@@ -27,16 +30,33 @@
 #endif
 
 #include <cctype>
+#include <cerrno>
 #include <ctime>
 #include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <climits>
+#include <csignal>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
 #include <thread>
 #include <sstream>
+#include <unordered_map>
+#include <vector>
 
 #include "Log.hpp"
+#include "Serialization.hpp"
 #include "Terminal.hpp"
+#include "Concurrent.hpp"
 
 namespace {
+	// set on the log writer thread while it writes a batch
+	thread_local bool batch_writing = false;
+
 	auto processID() {
 #ifdef _WIN32
 		return GetCurrentProcessId();
@@ -59,6 +79,10 @@ namespace {
 		explicit ConsoleLogOutput(FILE *fp_, bool mute_ = false) : LogOutput(mute_), m_fp(fp_) {
 			verbosity(4);
 		}
+
+		virtual void flush() override {
+			fflush(m_fp);
+		}
 	};
 
 	void ConsoleLogOutput::writeImpl(const gecom::logmessage &msg) {
@@ -135,7 +159,8 @@ namespace {
 		// write to output
 		std::string outtext = out.str();
 		fwrite(outtext.c_str(), 1, outtext.size(), m_fp);
-		fflush(m_fp);
+		// the log writer thread flushes once per batch
+		if (!batch_writing) fflush(m_fp);
 	}
 
 	class DebugLogOutput : public gecom::LogOutput {
@@ -158,6 +183,142 @@ namespace {
 	void DebugLogOutput::writeImpl(const gecom::logmessage &msg) { }
 #endif
 
+	// format time: https://www.ietf.org/rfc/rfc3339.txt
+	// 2015-07-29T12:43:15.123Z
+	// we always use 3 digit second-fraction
+	std::string formatTime(std::chrono::system_clock::time_point t1) {
+		using namespace std::chrono;
+
+		// truncate to seconds, use difference for second-fraction part of timestamp
+		auto t0 = time_point_cast<seconds>(t1);
+		std::time_t tt = std::chrono::system_clock::to_time_t(t0);
+		
+		// who the fuck thought tm was a good struct name?
+		std::tm *t = nullptr;
+
+		// why is this shit so terrible? WHY?
+#ifdef GECOM_HAVE_GMTIME_R
+		std::tm bullshit;
+		t = &bullshit;
+		gmtime_r(&tt, t);
+#else
+		t = std::gmtime(&tt);
+#endif
+
+		if (!t) return "0000-00-00T00:00:00.000Z";
+
+		char buf[64];
+		std::snprintf(
+			buf, sizeof(buf), "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ",
+			1900 + t->tm_year, 1 + t->tm_mon, t->tm_mday, t->tm_hour, t->tm_min, t->tm_sec,
+			int(duration_cast<milliseconds>(t1 - t0).count())
+		);
+		return buf;
+	}
+
+	// binary log format: a sequence of records, each of which is a size (as serializer::putSize)
+	// followed by that many bytes, starting with the record type. a log starts with a header
+	// record, which also resets the source table (so logs can be appended to).
+	// header: type, magic, uint8 version
+	// source: type, size index, string source
+	// message: type, int64 microseconds since epoch, uint8 level, size verbosity, size source index, string body
+	enum class binlog_record : uint8_t {
+		header, source, message
+	};
+
+	constexpr char binlog_magic[] = { 'g', 'e', 'c', 'o', 'm', 'l', 'o', 'g' };
+
+	constexpr uint8_t binlog_version = 1;
+
+	// bytes taken by serializer::putSize(x)
+	size_t serializedSizeLength(size_t x) {
+		size_t n = 1;
+		if (x >= 248) {
+			for (; x; x >>= 8) n++;
+		}
+		return n;
+	}
+
+	size_t serializedStringLength(const std::string &s) {
+		return serializedSizeLength(s.size()) + s.size();
+	}
+
+	// async log record, followed by source and body and padded to record_align
+	struct record_header {
+		uint32_t size;
+		uint32_t verbosity;
+		int64_t time;
+		uint32_t source_size;
+		uint32_t body_size;
+		gecom::loglevel level;
+	};
+
+	constexpr size_t record_align = 8;
+
+	// serialized log records from one thread; written by that thread, read by the log writer thread
+	class LogRing : private gecom::Uncopyable {
+	private:
+		static constexpr size_t cache_line = 64;
+
+		const size_t m_mask;
+		std::unique_ptr<char[]> m_buf;
+
+		// write position
+		alignas(cache_line) std::atomic<size_t> m_head { 0 };
+		// read position
+		alignas(cache_line) std::atomic<size_t> m_tail { 0 };
+
+		void copyIn(size_t pos, const void *src, size_t n) {
+			size_t i = pos & m_mask;
+			size_t n0 = std::min(n, m_mask + 1 - i);
+			std::memcpy(m_buf.get() + i, src, n0);
+			std::memcpy(m_buf.get(), static_cast<const char *>(src) + n0, n - n0);
+		}
+
+	public:
+		// set while the owning thread is writing a record
+		alignas(cache_line) std::atomic<bool> writing { false };
+		// set when the owning thread has exited
+		std::atomic<bool> orphaned { false };
+
+		explicit LogRing(size_t capacity) : m_mask(capacity - 1), m_buf(new char[capacity]) { }
+
+		size_t capacity() const {
+			return m_mask + 1;
+		}
+
+		size_t used() const {
+			return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+		}
+
+		// producer only; returns false if there isn't space
+		bool tryPush(const record_header &h, const std::string &source, const std::string &body) {
+			size_t head = m_head.load(std::memory_order_relaxed);
+			size_t tail = m_tail.load(std::memory_order_acquire);
+			if (capacity() - (head - tail) < h.size) return false;
+			copyIn(head, &h, sizeof(h));
+			copyIn(head + sizeof(h), source.data(), source.size());
+			copyIn(head + sizeof(h) + source.size(), body.data(), body.size());
+			m_head.store(head + h.size, std::memory_order_release);
+			return true;
+		}
+
+		// consumer only; append all records to out and release their space
+		void popAll(std::vector<char> &out) {
+			size_t head = m_head.load(std::memory_order_acquire);
+			size_t tail = m_tail.load(std::memory_order_relaxed);
+			size_t n = head - tail;
+			if (!n) return;
+			size_t i = tail & m_mask;
+			size_t n0 = std::min(n, m_mask + 1 - i);
+			out.insert(out.end(), m_buf.get() + i, m_buf.get() + i + n0);
+			out.insert(out.end(), m_buf.get(), m_buf.get() + (n - n0));
+			m_tail.store(head, std::memory_order_release);
+		}
+	};
+
+	class AsyncLogWriter;
+
 	struct LogStatics {
 		// stdio log outputs
 		ConsoleLogOutput stdout_logoutput { stdout, true };
@@ -169,86 +330,682 @@ namespace {
 		// other log outputs
 		std::mutex output_mutex;
 		std::unordered_set<gecom::LogOutput *> outputs;
+
+		// asynchronous logging
+		std::unique_ptr<AsyncLogWriter> async;
+
+		// repeat suppression and rate limiting
+		std::atomic<bool> deduplicate { true };
+		std::atomic<double> rate_limit { 0 };
+		std::atomic<unsigned> rate_burst { 100 };
+
+		LogStatics();
+		~LogStatics();
 	};
 
 	auto & logStatics() {
 		static LogStatics s;
 		return s;
 	}
-}
 
-namespace gecom {
+	// write to all outputs; output mutex assumed owned
+	void writeOutputs(const gecom::logmessage &msg) {
+		auto &statics = logStatics();
 
-	void Log::write(unsigned verbosity, loglevel level, const std::string &source, const std::string &body) {
-		std::unique_lock<std::mutex> lock(logStatics().output_mutex);
+		// write to debug
+		statics.debug_logoutput.write(msg);
 
-		using namespace std::chrono;
+		// write to stdio
+		statics.stderr_logoutput.write(msg);
+		statics.stdout_logoutput.write(msg);
 
-		// truncate to seconds, use difference for second-fraction part of timestamp
-		auto t1 = system_clock::now();
-		auto t0 = time_point_cast<seconds>(t1);
-		std::time_t tt = std::chrono::system_clock::to_time_t(t0);
-		
-		// who the fuck thought tm was a good struct name?
-		std::tm *t = nullptr;
+		// write to all others
+		for (gecom::LogOutput *out : statics.outputs) {
+			out->write(msg);
+		}
+	}
 
-		// why is this shit so terrible? WHY?
-#ifdef GECOM_HAVE_GMTIME_R
-		std::tm bullshit;
-		t = &bullshit;
-		gmtime_r(&tt, t);
-#else
-		t = std::gmtime(&tt);
-#endif
-		
-		// format time: https://www.ietf.org/rfc/rfc3339.txt
-		// 2015-07-29T12:43:15.123Z
-		// we always use 3 digit second-fraction
-		std::ostringstream timess;
-
-		if (t) {
-			timess << std::setfill('0');
-			timess << std::setw(4) << (1900 + t->tm_year) << '-';
-			timess << std::setw(2) << (1 + t->tm_mon) << '-';
-			timess << std::setw(2) << t->tm_mday << 'T';
-			timess << std::setw(2) << t->tm_hour << ':';
-			timess << std::setw(2) << t->tm_min << ':';
-			timess << std::setw(2) << t->tm_sec << '.';
-			timess << std::setw(3) << duration_cast<milliseconds>(t1 - t0).count() << 'Z';
-		} else {
-			timess << "0000-00-00T00:00:00.000Z";
+	// flush all outputs; output mutex assumed owned
+	void flushOutputs() {
+		auto &statics = logStatics();
+		statics.debug_logoutput.flush();
+		statics.stderr_logoutput.flush();
+		statics.stdout_logoutput.flush();
+		for (gecom::LogOutput *out : statics.outputs) {
+			out->flush();
+		}
+	}
+
+	// the calling thread's log ring, owned by the async log writer
+	// set once this thread's thread_local log state has been destroyed. messages logged after
+	// that (by destructors of other thread_locals or statics) are written synchronously.
+	thread_local bool log_thread_exited = false;
+
+	struct LogRingHolder {
+		LogRing *ring = nullptr;
+
+		~LogRingHolder() {
+			if (ring) ring->orphaned = true;
+			log_thread_exited = true;
+		}
+	};
+
+	thread_local LogRingHolder this_log_ring;
+
+	// set on the log writer thread
+	thread_local bool is_log_writer = false;
+
+	// moves log records from per-thread rings to the outputs on a background thread
+	class AsyncLogWriter : private gecom::Uncopyable {
+	private:
+		std::atomic<bool> m_running { false };
+		size_t m_buffer_size = 0;
+		gecom::logoverflow m_overflow = gecom::logoverflow::block;
+
+		// all rings, including those of exited threads until they are drained
+		std::mutex m_rings_mutex;
+		std::vector<std::unique_ptr<LogRing>> m_rings;
+
+		// writer thread control
+		std::mutex m_mutex;
+		std::condition_variable m_cond;
+		std::condition_variable m_pass_cond;
+		bool m_wake = false;
+		bool m_stop = false;
+		uint64_t m_flush_requested = 0;
+		uint64_t m_flush_done = 0;
+		uint64_t m_passes = 0;
+		// avoids taking the mutex for repeated wakeups before the writer runs
+		std::atomic<bool> m_wake_pending { false };
+		std::thread m_thread;
+
+		// messages discarded because a ring was full
+		std::atomic<size_t> m_dropped { 0 };
+
+		// reused between passes
+		std::vector<char> m_batch;
+		std::vector<size_t> m_records;
+		gecom::logmessage m_msg;
+
+		LogRing * threadRing() {
+			if (!this_log_ring.ring) {
+				std::unique_lock<std::mutex> lock(m_rings_mutex);
+				m_rings.push_back(std::make_unique<LogRing>(m_buffer_size));
+				this_log_ring.ring = m_rings.back().get();
+			}
+			return this_log_ring.ring;
+		}
+
+		void wake() {
+			if (m_wake_pending.exchange(true)) return;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_wake = true;
+			}
+			m_cond.notify_one();
+		}
+
+		// wake the writer and wait for it to finish a pass
+		void waitPass() {
+			std::unique_lock<std::mutex> lock(m_mutex);
+			const uint64_t passes0 = m_passes;
+			m_wake = true;
+			m_cond.notify_one();
+			m_pass_cond.wait(lock, [&]() { return m_passes != passes0; });
+		}
+
+		const record_header & header(size_t offset) const {
+			return *reinterpret_cast<const record_header *>(m_batch.data() + offset);
+		}
+
+		// drain all rings and write their records
+		void pass() {
+			std::vector<LogRing *> rings;
+			{
+				std::unique_lock<std::mutex> lock(m_rings_mutex);
+				// rings of exited threads are removed once empty
+				m_rings.erase(std::remove_if(m_rings.begin(), m_rings.end(), [](const std::unique_ptr<LogRing> &r) {
+					return r->orphaned && !r->used();
+				}), m_rings.end());
+				for (auto &r : m_rings) {
+					rings.push_back(r.get());
+				}
+			}
+			m_batch.clear();
+			for (LogRing *r : rings) {
+				r->popAll(m_batch);
+			}
+			// records are padded, so headers in the batch stay aligned
+			m_records.clear();
+			for (size_t offset = 0; offset < m_batch.size(); offset += header(offset).size) {
+				m_records.push_back(offset);
+			}
+			// order by time; per-thread order is kept by stable sort
+			std::stable_sort(m_records.begin(), m_records.end(), [this](size_t a, size_t b) {
+				return header(a).time < header(b).time;
+			});
+			const size_t dropped = m_dropped.exchange(0);
+			if (m_records.empty() && !dropped) return;
+			auto &statics = logStatics();
+			std::unique_lock<std::mutex> lock(statics.output_mutex);
+			batch_writing = true;
+			for (size_t offset : m_records) {
+				const record_header &h = header(offset);
+				const char *p = m_batch.data() + offset + sizeof(record_header);
+				m_msg.timestamp = std::chrono::system_clock::time_point(std::chrono::system_clock::duration(h.time));
+				m_msg.time = formatTime(m_msg.timestamp);
+				m_msg.level = h.level;
+				m_msg.verbosity = h.verbosity;
+				m_msg.source.assign(p, h.source_size);
+				m_msg.body.assign(p + h.source_size, h.body_size);
+				writeOutputs(m_msg);
+			}
+			if (dropped) {
+				m_msg.timestamp = std::chrono::system_clock::now();
+				m_msg.time = formatTime(m_msg.timestamp);
+				m_msg.level = gecom::loglevel::warning;
+				m_msg.verbosity = gecom::Log::defaultVerbosity(gecom::loglevel::warning);
+				m_msg.source = "Log";
+				m_msg.body = "Async log buffer full; discarded " + std::to_string(dropped) + " messages";
+				writeOutputs(m_msg);
+			}
+			batch_writing = false;
+			flushOutputs();
+		}
+
+		void run() {
+			is_log_writer = true;
+			gecom::setThreadName("log-writer");
+			std::unique_lock<std::mutex> lock(m_mutex);
+			while (true) {
+				// wake periodically regardless, so producers only need to wake us when it matters
+				m_cond.wait_for(lock, std::chrono::milliseconds(20), [&]() { return m_wake || m_stop; });
+				m_wake = false;
+				m_wake_pending = false;
+				const bool stop = m_stop;
+				const uint64_t flush_requested = m_flush_requested;
+				lock.unlock();
+				try {
+					pass();
+				} catch (...) {
+					// nowhere to report this
+				}
+				lock.lock();
+				m_passes++;
+				m_flush_done = flush_requested;
+				m_pass_cond.notify_all();
+				if (stop) break;
+			}
+		}
+
+	public:
+		bool running() const {
+			return m_running.load();
+		}
+
+		void start(size_t buffer_size, gecom::logoverflow overflow) {
+			if (m_running) return;
+			// rings must fit the largest record they accept, and have a power-of-2 size
+			size_t size = 4096;
+			while (size < buffer_size) size <<= 1;
+			m_buffer_size = size;
+			m_overflow = overflow;
+			m_stop = false;
+			m_thread = std::thread([this]() { run(); });
+			m_running = true;
+		}
+
+		void stop() {
+			if (!m_running) return;
+			m_running = false;
+			// wait for threads already writing records; the writer keeps running so they can't get stuck
+			while (true) {
+				bool writing = false;
+				{
+					std::unique_lock<std::mutex> lock(m_rings_mutex);
+					for (auto &r : m_rings) {
+						writing |= r->writing.load();
+					}
+				}
+				if (!writing) break;
+				std::this_thread::yield();
+			}
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_stop = true;
+			}
+			m_cond.notify_one();
+			m_thread.join();
+		}
+
+		// returns false if the message should be written synchronously instead
+		bool write(unsigned verbosity, gecom::loglevel level, const std::string &source, const std::string &body) {
+			const size_t size0 = sizeof(record_header) + source.size() + body.size();
+			const size_t size = (size0 + record_align - 1) & ~(record_align - 1);
+			// our ring may already have been drained and freed
+			if (log_thread_exited) return false;
+			LogRing *r = threadRing();
+			if (size > r->capacity() / 2) {
+				// the writer holds the output lock, so it can't write synchronously
+				if (is_log_writer) {
+					m_dropped++;
+					return true;
+				}
+				// too big to ever fit; the caller flushes first, so order is preserved
+				return false;
+			}
+			record_header h;
+			h.size = uint32_t(size);
+			h.verbosity = verbosity;
+			h.time = std::chrono::system_clock::now().time_since_epoch().count();
+			h.source_size = uint32_t(source.size());
+			h.body_size = uint32_t(body.size());
+			h.level = level;
+			// pairs with stop(): either stop sees us writing, or we see it has stopped
+			r->writing.store(true);
+			if (!m_running.load()) {
+				r->writing.store(false, std::memory_order_release);
+				return false;
+			}
+			while (!r->tryPush(h, source, body)) {
+				if (m_overflow == gecom::logoverflow::drop || is_log_writer) {
+					// the writer can't wait for itself
+					m_dropped++;
+					break;
+				}
+				waitPass();
+			}
+			r->writing.store(false, std::memory_order_release);
+			if (r->used() > r->capacity() / 2) wake();
+			return true;
+		}
+
+		void flush() {
+			// the writer flushes after each batch anyway
+			if (is_log_writer) return;
+			std::unique_lock<std::mutex> lock(m_mutex);
+			const uint64_t ticket = ++m_flush_requested;
+			m_wake = true;
+			m_cond.notify_one();
+			m_pass_cond.wait(lock, [&]() { return m_flush_done >= ticket; });
+		}
+
+		~AsyncLogWriter() {
+			stop();
+		}
+	};
+
+	LogStatics::LogStatics() : async(std::make_unique<AsyncLogWriter>()) { }
+
+	LogStatics::~LogStatics() { }
+
+	// write a message that has passed filtering
+	void writeMessage(unsigned verbosity, gecom::loglevel level, const std::string &source, const std::string &body) {
+		auto &statics = logStatics();
+
+		if (statics.async->running()) {
+			if (statics.async->write(verbosity, level, source, body)) {
+				// critical messages must be out before we return
+				if (level == gecom::loglevel::critical) statics.async->flush();
+				return;
+			}
+			// writing synchronously; anything queued goes first
+			statics.async->flush();
 		}
 
 		// prepare the message
-		logmessage msg;
-		msg.time = timess.str();
+		gecom::logmessage msg;
+		msg.timestamp = std::chrono::system_clock::now();
+		msg.time = formatTime(msg.timestamp);
 		msg.level = level;
 		msg.verbosity = verbosity;
 		msg.source = source;
 		msg.body = body;
 
-		// write to debug
-		logStatics().debug_logoutput.write(msg);
+		std::unique_lock<std::mutex> lock(statics.output_mutex);
+		writeOutputs(msg);
+	}
 
-		// write to stdio
-		logStatics().stderr_logoutput.write(msg);
-		logStatics().stdout_logoutput.write(msg);
+	// per-source rate limit state
+	struct log_bucket {
+		double tokens = 0;
+		std::chrono::steady_clock::time_point time;
+		size_t suppressed = 0;
+	};
 
-		// write to all others
-		for (LogOutput *out : logStatics().outputs) {
-			out->write(msg);
+	// repeat suppression and rate limiting state for one thread.
+	// sources include the thread id, so there is nothing to share between threads.
+	struct LogFilter {
+		// last message written
+		bool has_last = false;
+		size_t last_hash = 0;
+		std::string last_source;
+		unsigned last_verbosity = 0;
+		gecom::loglevel last_level = gecom::loglevel::info;
+
+		// repeats of the last message since it was written or last reported
+		size_t repeats = 0;
+		std::chrono::steady_clock::time_point repeats_time;
+
+		// rate limit buckets by source
+		static constexpr size_t max_buckets = 4096;
+		std::unordered_map<std::string, log_bucket> buckets;
+
+		~LogFilter() {
+			// don't lose counts for a thread's last messages
+			reportRepeats();
+			for (auto &b : buckets) {
+				reportSuppressed(b.first, b.second);
+			}
+			log_thread_exited = true;
+		}
+
+		void reportRepeats() {
+			if (!repeats) return;
+			writeMessage(last_verbosity, last_level, last_source, "Last message repeated " + std::to_string(repeats) + " times");
+			repeats = 0;
+		}
+
+		void reportSuppressed(const std::string &source, log_bucket &b) {
+			if (!b.suppressed) return;
+			writeMessage(
+				gecom::Log::defaultVerbosity(gecom::loglevel::warning), gecom::loglevel::warning, source,
+				"Rate limit exceeded; suppressed " + std::to_string(b.suppressed) + " messages"
+			);
+			b.suppressed = 0;
+		}
+
+		// forget sources that have been quiet long enough for their buckets to refill.
+		// if that isn't enough, forget the rest too; suppressed counts are reported, not lost.
+		void pruneBuckets(std::chrono::steady_clock::time_point now, double rate, double burst) {
+			using namespace std::chrono;
+			const auto refill = duration_cast<steady_clock::duration>(duration<double>(burst / rate));
+			for (int pass = 0; pass < 2 && buckets.size() > max_buckets / 2; pass++) {
+				for (auto it = buckets.begin(); it != buckets.end(); ) {
+					if (pass || now - it->second.time >= refill) {
+						reportSuppressed(it->first, it->second);
+						it = buckets.erase(it);
+					} else {
+						++it;
+					}
+				}
+			}
+		}
+
+		// returns false if the message should not be written
+		bool accept(unsigned verbosity, gecom::loglevel level, const std::string &source, const std::string &body) {
+			using namespace std::chrono;
+			auto &statics = logStatics();
+			const auto now = steady_clock::now();
+
+			if (statics.deduplicate.load(std::memory_order_relaxed)) {
+				const size_t hash = std::hash<std::string>()(body);
+				if (has_last && hash == last_hash && verbosity == last_verbosity && level == last_level && source == last_source) {
+					if (!repeats) repeats_time = now;
+					repeats++;
+					// long runs are reported every second
+					if (now - repeats_time >= seconds(1)) reportRepeats();
+					return false;
+				}
+				reportRepeats();
+				has_last = true;
+				last_hash = hash;
+				last_source = source;
+				last_verbosity = verbosity;
+				last_level = level;
+			}
+
+			const double rate = statics.rate_limit.load(std::memory_order_relaxed);
+			if (rate > 0) {
+				const double burst = statics.rate_burst.load(std::memory_order_relaxed);
+				// bounded; sections and sources that have gone quiet can be forgotten
+				if (buckets.size() >= max_buckets) pruneBuckets(now, rate, burst);
+				auto it = buckets.find(source);
+				if (it == buckets.end()) {
+					it = buckets.emplace(source, log_bucket()).first;
+					it->second.tokens = burst;
+					it->second.time = now;
+				}
+				log_bucket &b = it->second;
+				b.tokens = std::min(burst, b.tokens + rate * duration_cast<duration<double>>(now - b.time).count());
+				b.time = now;
+				if (b.tokens < 1) {
+					b.suppressed++;
+					return false;
+				}
+				b.tokens -= 1;
+				reportSuppressed(source, b);
+			}
+
+			return true;
+		}
+	};
+
+	thread_local LogFilter this_log_filter;
+
+	// flight recorders to dump on a fatal signal; slots are claimed with a CAS
+	constexpr size_t max_flight_recorders = 8;
+	std::atomic<gecom::FlightRecorderLogOutput *> flight_recorders[max_flight_recorders];
+
+	// number of registered flight recorders
+	std::atomic<unsigned> flight_recorder_count { 0 };
+
+	// async-signal-safe
+	void dumpFlightRecorders(const char *note) {
+		for (auto &r : flight_recorders) {
+			if (gecom::FlightRecorderLogOutput *p = r.load()) p->dump(note);
 		}
-		
+	}
+
+	// stack space for the fatal signal handler on one thread, so that a stack overflow can still
+	// be dumped. the handler needs its dump buffer (4KiB) and some frames on top of SIGSTKSZ.
+	class SignalStack : private gecom::Uncopyable {
+	private:
+#ifdef GECOM_PLATFORM_POSIX
+		std::unique_ptr<char[]> m_stack;
+#endif
+
+	public:
+		SignalStack() {
+#if defined(GECOM_PLATFORM_WIN32)
+			// stack overflow exceptions only get this much stack to run their handlers in
+			ULONG size = 64 * 1024;
+			SetThreadStackGuarantee(&size);
+#elif defined(GECOM_PLATFORM_POSIX)
+			const size_t size = size_t(SIGSTKSZ) + 64 * 1024;
+			stack_t ss;
+			// keep an existing alternate stack (e.g. from a sanitizer) if it is big enough
+			if (sigaltstack(nullptr, &ss) == 0 && !(ss.ss_flags & SS_DISABLE) && ss.ss_size >= size) return;
+			m_stack.reset(new char[size]);
+			ss.ss_sp = m_stack.get();
+			ss.ss_size = size;
+			ss.ss_flags = 0;
+			if (sigaltstack(&ss, nullptr) != 0) m_stack.reset();
+#endif
+		}
+
+		~SignalStack() {
+#ifdef GECOM_PLATFORM_POSIX
+			if (!m_stack) return;
+			stack_t ss;
+			std::memset(&ss, 0, sizeof(ss));
+			ss.ss_flags = SS_DISABLE;
+			sigaltstack(&ss, nullptr);
+#endif
+		}
+	};
+
+	// give the calling thread a signal stack, once
+	void ensureSignalStack() {
+		thread_local SignalStack s;
+		(void) s;
+	}
+
+#ifdef GECOM_PLATFORM_WIN32
+	LPTOP_LEVEL_EXCEPTION_FILTER previous_exception_filter = nullptr;
+
+	LONG WINAPI flightRecorderExceptionFilter(EXCEPTION_POINTERS *e) {
+		dumpFlightRecorders("Unhandled exception");
+		return previous_exception_filter ? previous_exception_filter(e) : EXCEPTION_CONTINUE_SEARCH;
+	}
+
+	void flightRecorderAbortHandler(int sig) {
+		dumpFlightRecorders("Fatal signal SIGABRT");
+		std::signal(sig, SIG_DFL);
+		std::raise(sig);
+	}
+
+	void installFlightRecorderHandlers() {
+		previous_exception_filter = SetUnhandledExceptionFilter(flightRecorderExceptionFilter);
+		std::signal(SIGABRT, flightRecorderAbortHandler);
+	}
+#else
+	const int fatal_signals[] { SIGSEGV, SIGABRT, SIGBUS, SIGILL, SIGFPE };
+	const char * const fatal_signal_notes[] {
+		"Fatal signal SIGSEGV", "Fatal signal SIGABRT", "Fatal signal SIGBUS", "Fatal signal SIGILL", "Fatal signal SIGFPE"
+	};
+	struct sigaction previous_signal_actions[5];
+
+	void flightRecorderSignalHandler(int sig) {
+		for (size_t i = 0; i < 5; i++) {
+			if (fatal_signals[i] != sig) continue;
+			dumpFlightRecorders(fatal_signal_notes[i]);
+			// let the previous handler (or the default action) deal with it
+			sigaction(sig, &previous_signal_actions[i], nullptr);
+			raise(sig);
+			return;
+		}
+	}
+
+	void installFlightRecorderHandlers() {
+		struct sigaction sa;
+		std::memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = flightRecorderSignalHandler;
+		sigemptyset(&sa.sa_mask);
+		sa.sa_flags = SA_ONSTACK;
+		for (size_t i = 0; i < 5; i++) {
+			sigaction(fatal_signals[i], &sa, &previous_signal_actions[i]);
+		}
+	}
+#endif
+}
+
+namespace gecom {
+
+	void LogOutput::verbosity(unsigned v) {
+		m_verbosity.store(v, std::memory_order_relaxed);
+		Log::outputsChanged();
+	}
+
+	void LogOutput::mute(bool b) {
+		m_mute.store(b, std::memory_order_relaxed);
+		Log::outputsChanged();
+	}
+
+	std::atomic<unsigned> Log::s_verbosity_limit { 0 };
+
+	std::atomic<unsigned> Log::s_outputs_changes { 1 };
+
+	std::atomic<unsigned> Log::s_limit_changes { 0 };
+
+	bool Log::enabledSlow(unsigned verbosity) {
+		auto &statics = logStatics();
+		// an output may log from inside write(); don't wait for ourselves
+		std::unique_lock<std::mutex> lock(statics.output_mutex, std::try_to_lock);
+		if (!lock) return true;
+		// outputs changing while we look will bump this again, so the limit
+		// is only ever published as current for the changes we have seen
+		const unsigned changes = s_outputs_changes.load(std::memory_order_acquire);
+		unsigned limit = 0;
+		auto update = [&](const LogOutput *out) {
+			if (!out->mute()) limit = std::max(limit, out->verbosity());
+		};
+		update(&statics.debug_logoutput);
+		update(&statics.stderr_logoutput);
+		update(&statics.stdout_logoutput);
+		for (LogOutput *out : statics.outputs) {
+			update(out);
+		}
+		s_verbosity_limit.store(limit, std::memory_order_relaxed);
+		s_limit_changes.store(changes, std::memory_order_release);
+		return verbosity < limit;
+	}
+
+	std::string Log::fullSource(const std::string &source) {
+		std::string r;
+		r.reserve(64);
+		std::ostringstream ids;
+		ids << processID() << '/' << std::this_thread::get_id() << '/';
+		r += ids.str();
+		const section *sec = section::current();
+		if (sec) r += sec->path();
+		// a source with the same name as the current section doesn't start a new one
+		if (!source.empty() && !(sec && sec->name() == source)) {
+			r += source;
+			r += '/';
+		}
+		return r;
+	}
+
+	void Log::write(unsigned verbosity, loglevel level, const std::string &source, const std::string &body) {
+		if (!enabled(verbosity)) return;
+		// any thread that logs may be the one to crash
+		if (flight_recorder_count.load(std::memory_order_relaxed)) ensureSignalStack();
+		// critical messages are never suppressed; nor are messages during thread exit
+		if (level != loglevel::critical && !log_thread_exited && !this_log_filter.accept(verbosity, level, source, body)) return;
+		writeMessage(verbosity, level, source, body);
 	}
 
 	void Log::addOutput(LogOutput *out) {
 		std::unique_lock<std::mutex> lock(logStatics().output_mutex);
 		logStatics().outputs.insert(out);
+		outputsChanged();
 	}
 
 	void Log::removeOutput(LogOutput *out) {
 		std::unique_lock<std::mutex> lock(logStatics().output_mutex);
 		logStatics().outputs.erase(out);
+		outputsChanged();
+	}
+
+	void Log::deduplicate(bool b) {
+		logStatics().deduplicate = b;
+	}
+
+	bool Log::deduplicate() {
+		return logStatics().deduplicate;
+	}
+
+	void Log::rateLimit(double rate, unsigned burst) {
+		auto &statics = logStatics();
+		statics.rate_burst = std::max(burst, 1u);
+		statics.rate_limit = rate;
+	}
+
+	void Log::startAsync(size_t buffer_size, logoverflow overflow) {
+		logStatics().async->start(buffer_size, overflow);
+	}
+
+	void Log::stopAsync() {
+		logStatics().async->stop();
+	}
+
+	bool Log::async() {
+		return logStatics().async->running();
+	}
+
+	void Log::flush() {
+		auto &statics = logStatics();
+		if (statics.async->running()) {
+			statics.async->flush();
+		} else {
+			std::unique_lock<std::mutex> lock(statics.output_mutex);
+			flushOutputs();
+		}
+	}
+
+	bool Log::batching() {
+		return batch_writing;
 	}
 
 	LogOutput * Log::stdOut() {
@@ -264,16 +1021,8 @@ namespace gecom {
 	}
 
 	logstream Log::info(const std::string &source) {
-		std::ostringstream fullsource;
-		fullsource << processID() << '/';
-		fullsource << std::this_thread::get_id() << '/';
-		if (!source.empty()) {
-			section_guard sec(source);
-			fullsource << section::current()->path();
-		} else if (const section *sec = section::current()) {
-			fullsource << sec->path();
-		}
-		return logstream(fullsource.str());
+		// the stream expands the source when it writes the message, if at all
+		return logstream(source);
 	}
 
 	logstream Log::warning(const std::string &source) {
@@ -288,6 +1037,529 @@ namespace gecom {
 		return std::move(info(source).critical());
 	}
 
+	BinaryLogOutput::BinaryLogOutput(const std::string &fname_, std::ios::openmode mode_, bool mute_) :
+		LogOutput(mute_), m_out(std::make_unique<file_serializer>(fname_, mode_))
+	{
+		if (!m_out->is_open()) {
+			throw std::runtime_error("unable to open file");
+		}
+		m_out->putSize(1 + sizeof(binlog_magic) + 1);
+		m_out->putInt(uint8_t(binlog_record::header));
+		m_out->write(binlog_magic, sizeof(binlog_magic));
+		m_out->putInt(binlog_version);
+		m_out->flush();
+	}
+
+	void BinaryLogOutput::writeImpl(const logmessage &msg) {
+		auto it = m_sources.find(msg.source);
+		if (it == m_sources.end()) {
+			it = m_sources.emplace(msg.source, m_sources.size()).first;
+			m_out->putSize(1 + serializedSizeLength(it->second) + serializedStringLength(msg.source));
+			m_out->putInt(uint8_t(binlog_record::source));
+			m_out->putSize(it->second);
+			*m_out << msg.source;
+		}
+		const int64_t time = std::chrono::duration_cast<std::chrono::microseconds>(msg.timestamp.time_since_epoch()).count();
+		m_out->putSize(
+			1 + sizeof(int64_t) + 1 + serializedSizeLength(msg.verbosity)
+			+ serializedSizeLength(it->second) + serializedStringLength(msg.body)
+		);
+		m_out->putInt(uint8_t(binlog_record::message));
+		m_out->putInt(time);
+		m_out->putInt(uint8_t(msg.level));
+		m_out->putSize(msg.verbosity);
+		m_out->putSize(it->second);
+		*m_out << msg.body;
+		if (msg.level == loglevel::critical) m_out->flush();
+	}
+
+	void BinaryLogOutput::flush() {
+		m_out->flush();
+	}
+
+	BinaryLogOutput::~BinaryLogOutput() { }
+
+	BinaryLogReader::BinaryLogReader(const std::string &fname_) : m_in(std::make_unique<file_deserializer>(fname_)) {
+		if (!m_in->is_open()) {
+			throw std::runtime_error("unable to open file");
+		}
+		char magic[sizeof(binlog_magic)] { };
+		m_in->getSize();
+		const auto type = m_in->getInt<uint8_t>();
+		m_in->read(magic, sizeof(magic));
+		if (!*m_in || type != uint8_t(binlog_record::header) || !std::equal(magic, magic + sizeof(magic), binlog_magic)) {
+			throw std::runtime_error("not a binary log");
+		}
+		if (m_in->getInt<uint8_t>() != binlog_version) {
+			throw std::runtime_error("unsupported binary log version");
+		}
+	}
+
+	BinaryLogReader::~BinaryLogReader() { }
+
+	bool BinaryLogReader::read(logmessage &msg) {
+		while (*m_in) {
+			if (m_in->peek() == std::char_traits<char>::eof()) return false;
+			const size_t size = m_in->getSize();
+			if (!size) throw std::runtime_error("corrupt binary log");
+			const auto type = binlog_record(m_in->getInt<uint8_t>());
+			switch (type) {
+			case binlog_record::header:
+			{
+				// appended log; sources start again
+				char magic[sizeof(binlog_magic)] { };
+				m_in->read(magic, sizeof(magic));
+				if (m_in->getInt<uint8_t>() != binlog_version || !std::equal(magic, magic + sizeof(magic), binlog_magic)) {
+					if (!*m_in) return false;
+					throw std::runtime_error("corrupt binary log");
+				}
+				m_sources.clear();
+				break;
+			}
+			case binlog_record::source:
+			{
+				const size_t index = m_in->getSize();
+				std::string source;
+				*m_in >> source;
+				if (!*m_in) return false;
+				if (index != m_sources.size()) throw std::runtime_error("corrupt binary log");
+				m_sources.push_back(std::move(source));
+				break;
+			}
+			case binlog_record::message:
+			{
+				const auto time = m_in->getInt<int64_t>();
+				const auto level = m_in->getInt<uint8_t>();
+				msg.verbosity = unsigned(m_in->getSize());
+				const size_t source = m_in->getSize();
+				*m_in >> msg.body;
+				if (!*m_in) return false;
+				if (level > uint8_t(loglevel::critical) || source >= m_sources.size()) {
+					throw std::runtime_error("corrupt binary log");
+				}
+				msg.level = loglevel(level);
+				msg.source = m_sources[source];
+				msg.timestamp = std::chrono::system_clock::time_point(
+					std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::microseconds(time))
+				);
+				msg.time = formatTime(msg.timestamp);
+				return true;
+			}
+			default:
+				// unknown record from a newer writer; skip it
+				for (size_t i = 1; i < size && *m_in; i++) {
+					m_in->get();
+				}
+				break;
+			}
+		}
+		return false;
+	}
+
+	// a log file mapped into memory at its full size, written as a streambuf.
+	// writing past the end fails rather than growing the file.
+	class RotatingLogOutput::segment : public std::streambuf, private Uncopyable {
+	private:
+		char *m_data = nullptr;
+		size_t m_size = 0;
+#ifdef GECOM_PLATFORM_WIN32
+		HANDLE m_file = INVALID_HANDLE_VALUE;
+		HANDLE m_mapping = nullptr;
+#else
+		int m_fd = -1;
+#endif
+
+	public:
+		// throws std::runtime_error if the file can't be created or mapped
+		segment(const std::string &fname, size_t size) : m_size(size) {
+#ifdef GECOM_PLATFORM_WIN32
+			m_file = CreateFileA(
+				fname.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ,
+				nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr
+			);
+			if (m_file == INVALID_HANDLE_VALUE) throw std::runtime_error("unable to open file");
+			// sizes the file too
+			m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READWRITE, DWORD(uint64_t(size) >> 32), DWORD(size), nullptr);
+			if (m_mapping) m_data = static_cast<char *>(MapViewOfFile(m_mapping, FILE_MAP_WRITE, 0, 0, size));
+#else
+			m_fd = ::open(fname.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+			if (m_fd < 0) throw std::runtime_error("unable to open file");
+			// reserve the blocks up front: writing to a page of a sparse file
+			// with no space left raises SIGBUS instead of failing
+#ifdef GECOM_PLATFORM_MAC
+			fstore_t store { F_ALLOCATEALL, F_PEOFPOSMODE, 0, off_t(size), 0 };
+			const bool reserved = ::fcntl(m_fd, F_PREALLOCATE, &store) != -1 && ::ftruncate(m_fd, off_t(size)) == 0;
+#else
+			const bool reserved = ::posix_fallocate(m_fd, 0, off_t(size)) == 0;
+#endif
+			if (reserved) {
+				void *p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+				if (p != MAP_FAILED) m_data = static_cast<char *>(p);
+			}
+#endif
+			if (!m_data) {
+				close(0);
+				throw std::runtime_error("unable to map file");
+			}
+		}
+
+		// start writing at pos
+		void seek(size_t pos) {
+			setp(m_data + pos, m_data + m_size);
+		}
+
+		// end of what has been written
+		size_t tell() const {
+			return pptr() - m_data;
+		}
+
+		// unmap and trim the file to the bytes used
+		void close(size_t used) {
+#ifdef GECOM_PLATFORM_WIN32
+			if (m_data) UnmapViewOfFile(m_data);
+			if (m_mapping) CloseHandle(m_mapping);
+			if (m_file != INVALID_HANDLE_VALUE) {
+				LARGE_INTEGER end;
+				end.QuadPart = LONGLONG(used);
+				if (SetFilePointerEx(m_file, end, nullptr, FILE_BEGIN)) SetEndOfFile(m_file);
+				CloseHandle(m_file);
+			}
+			m_mapping = nullptr;
+			m_file = INVALID_HANDLE_VALUE;
+#else
+			if (m_data) ::munmap(m_data, m_size);
+			if (m_fd >= 0) {
+				if (::ftruncate(m_fd, off_t(used)) != 0) {
+					// leaves trailing zeros; nothing better to do
+				}
+				::close(m_fd);
+			}
+			m_fd = -1;
+#endif
+			m_data = nullptr;
+		}
+
+		~segment() {
+			close(m_size);
+		}
+	};
+
+	RotatingLogOutput::RotatingLogOutput(
+		const std::string &fname_,
+		size_t segment_size_,
+		unsigned keep_,
+		std::chrono::steady_clock::duration max_age_,
+		bool mute_
+	) :
+		LogOutput(mute_),
+		m_fname(fname_),
+		m_segment_size(std::max<size_t>(segment_size_, 4096)),
+		m_keep(keep_),
+		m_max_age(max_age_)
+	{
+		rotate();
+		if (!m_segment) throw std::runtime_error("unable to open file");
+	}
+
+	std::string RotatingLogOutput::rotatedName(unsigned i) const {
+		return m_fname + '.' + std::to_string(i);
+	}
+
+	void RotatingLogOutput::rotate() {
+		if (m_segment) {
+			m_stream.rdbuf(nullptr);
+			m_segment->close(m_tail.load(std::memory_order_relaxed));
+			m_segment.reset();
+		}
+		// shift old files up, deleting the oldest
+		if (m_keep) {
+			std::remove(rotatedName(m_keep).c_str());
+			for (unsigned i = m_keep; i-- > 1; ) {
+				std::rename(rotatedName(i).c_str(), rotatedName(i + 1).c_str());
+			}
+			std::rename(m_fname.c_str(), rotatedName(1).c_str());
+		} else {
+			std::remove(m_fname.c_str());
+		}
+		open();
+	}
+
+	void RotatingLogOutput::open() {
+		m_tail.store(0, std::memory_order_release);
+		try {
+			m_segment = std::make_unique<segment>(m_fname, m_segment_size);
+			m_opened = std::chrono::steady_clock::now();
+		} catch (std::runtime_error &) {
+			// try again with the next message
+		}
+	}
+
+	void RotatingLogOutput::writeImpl(const logmessage &msg) {
+		if (!m_segment) open();
+		if (!m_segment) return;
+		// an empty file is never rotated
+		const bool old = m_max_age != std::chrono::steady_clock::duration::zero() && std::chrono::steady_clock::now() - m_opened >= m_max_age;
+		if (old && m_tail.load(std::memory_order_relaxed)) rotate();
+		while (m_segment) {
+			const size_t tail = m_tail.load(std::memory_order_relaxed);
+			m_segment->seek(tail);
+			// also clears any error from last time
+			m_stream.rdbuf(m_segment.get());
+			m_stream << msg << '\n';
+			// if it didn't fit, the partial message is past the tail and will be trimmed
+			if (m_stream.good() || !tail) {
+				m_tail.store(m_segment->tell(), std::memory_order_release);
+				return;
+			}
+			rotate();
+		}
+	}
+
+	RotatingLogOutput::~RotatingLogOutput() {
+		if (m_segment) m_segment->close(m_tail.load(std::memory_order_relaxed));
+	}
+
+	// log records (as for async logging) in a fixed-size buffer, oldest evicted first
+	class FlightRecorderLogOutput::ring : private Uncopyable {
+	private:
+		std::unique_ptr<char[]> m_data;
+		size_t m_size;
+		// positions as total bytes written; published after each record
+		std::atomic<uint64_t> m_head { 0 };
+		std::atomic<uint64_t> m_tail { 0 };
+
+		void copyIn(uint64_t pos, const void *src, size_t n) {
+			const size_t i = size_t(pos % m_size);
+			const size_t n0 = std::min(n, m_size - i);
+			std::memcpy(m_data.get() + i, src, n0);
+			std::memcpy(m_data.get(), static_cast<const char *>(src) + n0, n - n0);
+		}
+
+		void copyOut(uint64_t pos, void *dst, size_t n) const {
+			const size_t i = size_t(pos % m_size);
+			const size_t n0 = std::min(n, m_size - i);
+			std::memcpy(dst, m_data.get() + i, n0);
+			std::memcpy(static_cast<char *>(dst) + n0, m_data.get(), n - n0);
+		}
+
+	public:
+		explicit ring(size_t size) : m_data(new char[size]), m_size(size) { }
+
+		void push(const logmessage &msg) {
+			record_header h;
+			// bodies too big for the whole ring are truncated
+			const size_t source_size = std::min(msg.source.size(), m_size / 4);
+			const size_t body_size = std::min(msg.body.size(), m_size - sizeof(h) - source_size);
+			h.size = uint32_t(sizeof(h) + source_size + body_size);
+			h.verbosity = msg.verbosity;
+			h.time = msg.timestamp.time_since_epoch().count();
+			h.source_size = uint32_t(source_size);
+			h.body_size = uint32_t(body_size);
+			h.level = msg.level;
+			const uint64_t head = m_head.load(std::memory_order_relaxed);
+			uint64_t tail = m_tail.load(std::memory_order_relaxed);
+			while (head + h.size - tail > m_size) {
+				uint32_t size;
+				copyOut(tail, &size, sizeof(size));
+				tail += size;
+			}
+			m_tail.store(tail, std::memory_order_release);
+			copyIn(head, &h, sizeof(h));
+			copyIn(head + sizeof(h), msg.source.data(), source_size);
+			copyIn(head + sizeof(h) + source_size, msg.body.data(), body_size);
+			m_head.store(head + h.size, std::memory_order_release);
+		}
+
+		// write the records to a file as text, oldest first; async-signal-safe
+		bool dump(const char *fname, const char *note) const noexcept;
+	};
+
+	bool FlightRecorderLogOutput::ring::dump(const char *fname, const char *note) const noexcept {
+		// buffered writes, with no allocation
+		struct dump_file {
+#ifdef GECOM_PLATFORM_WIN32
+			HANDLE f = INVALID_HANDLE_VALUE;
+#else
+			int fd = -1;
+#endif
+			char buf[4096];
+			size_t n = 0;
+			bool ok = true;
+
+			void flush() {
+				const char *p = buf;
+#ifdef GECOM_PLATFORM_WIN32
+				DWORD w = 0;
+				if (n && !(WriteFile(f, p, DWORD(n), &w, nullptr) && w == n)) ok = false;
+#else
+				while (ok && n) {
+					const ssize_t w = ::write(fd, p, n);
+					if (w < 0 && errno == EINTR) continue;
+					if (w <= 0) ok = false;
+					if (w > 0) {
+						p += w;
+						n -= size_t(w);
+					}
+				}
+#endif
+				n = 0;
+			}
+
+			void put(char c) {
+				if (n == sizeof(buf)) flush();
+				buf[n++] = c;
+			}
+
+			void put(const char *s, size_t k) {
+				for (size_t i = 0; i < k; i++) put(s[i]);
+			}
+
+			void put(const char *s) {
+				put(s, std::strlen(s));
+			}
+
+			void putUnsigned(uint64_t x, int width = 0) {
+				char digits[24];
+				int k = 0;
+				do {
+					digits[k++] = char('0' + x % 10);
+					x /= 10;
+				} while (x);
+				for (; k < width; width--) put('0');
+				while (k) put(digits[--k]);
+			}
+		} out;
+
+#ifdef GECOM_PLATFORM_WIN32
+		out.f = CreateFileA(fname, GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (out.f == INVALID_HANDLE_VALUE) return false;
+#else
+		out.fd = ::open(fname, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (out.fd < 0) return false;
+#endif
+
+		const uint64_t head = m_head.load(std::memory_order_acquire);
+		for (uint64_t pos = m_tail.load(std::memory_order_acquire); pos < head; ) {
+			record_header h;
+			copyOut(pos, &h, sizeof(h));
+			// stop at anything overwritten while we were reading
+			if (h.size > head - pos || h.size != sizeof(h) + h.source_size + h.body_size) break;
+
+			// same format as logmessage, but without gmtime() or streams
+			using namespace std::chrono;
+			const int64_t ms = duration_cast<milliseconds>(system_clock::duration(h.time)).count();
+			const int64_t days = (ms >= 0 ? ms : ms - 86399999) / 86400000;
+			const int64_t msday = ms - days * 86400000;
+			// civil date from days since 1970-01-01 (proleptic gregorian)
+			const int64_t z = days + 719468;
+			const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+			const int64_t doe = z - era * 146097;
+			const int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+			const int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+			const int64_t mp = (5 * doy + 2) / 153;
+			const int64_t d = doy - (153 * mp + 2) / 5 + 1;
+			const int64_t m = mp < 10 ? mp + 3 : mp - 9;
+			const int64_t y = yoe + era * 400 + (m <= 2);
+			out.putUnsigned(uint64_t(y), 4);
+			out.put('-');
+			out.putUnsigned(uint64_t(m), 2);
+			out.put('-');
+			out.putUnsigned(uint64_t(d), 2);
+			out.put('T');
+			out.putUnsigned(uint64_t(msday / 3600000), 2);
+			out.put(':');
+			out.putUnsigned(uint64_t(msday / 60000 % 60), 2);
+			out.put(':');
+			out.putUnsigned(uint64_t(msday / 1000 % 60), 2);
+			out.put('.');
+			out.putUnsigned(uint64_t(msday % 1000), 3);
+			out.put("Z | ");
+			out.putUnsigned(h.verbosity);
+			out.put("> ");
+
+			const char *level = "???";
+			switch (h.level) {
+			case loglevel::info:
+				level = "Information";
+				break;
+			case loglevel::warning:
+				level = "Warning";
+				break;
+			case loglevel::error:
+				level = "Error";
+				break;
+			case loglevel::critical:
+				level = "Critical";
+				break;
+			}
+			for (size_t i = std::strlen(level); i < 11; i++) out.put(' ');
+			out.put(level);
+
+			out.put(" [");
+			pos += sizeof(h);
+			for (uint32_t i = 0; i < h.source_size; i++) out.put(m_data[(pos + i) % m_size]);
+			out.put("] : ");
+			pos += h.source_size;
+			for (uint32_t i = 0; i < h.body_size; i++) {
+				const char c = m_data[(pos + i) % m_size];
+				if (c == '\r' || c == '\n') {
+					// start multiline messages on a new line
+					out.put('\n');
+					break;
+				}
+			}
+			for (uint32_t i = 0; i < h.body_size; i++) out.put(m_data[(pos + i) % m_size]);
+			out.put('\n');
+			pos += h.body_size;
+		}
+
+		if (note) {
+			out.put(note);
+			out.put('\n');
+		}
+		out.flush();
+#ifdef GECOM_PLATFORM_WIN32
+		CloseHandle(out.f);
+#else
+		::close(out.fd);
+#endif
+		return out.ok;
+	}
+
+	FlightRecorderLogOutput::FlightRecorderLogOutput(const std::string &dump_fname_, size_t size_, bool mute_) :
+		LogOutput(mute_),
+		m_ring(std::make_unique<ring>(std::max<size_t>(size_, 4096))),
+		m_fname(dump_fname_)
+	{
+		static std::once_flag install_once;
+		std::call_once(install_once, installFlightRecorderHandlers);
+		ensureSignalStack();
+		bool registered = false;
+		for (auto &r : flight_recorders) {
+			FlightRecorderLogOutput *expected = nullptr;
+			if ((registered = r.compare_exchange_strong(expected, this))) break;
+		}
+		if (!registered) throw std::runtime_error("too many flight recorders");
+		flight_recorder_count++;
+	}
+
+	void FlightRecorderLogOutput::writeImpl(const logmessage &msg) {
+		m_ring->push(msg);
+		if (msg.level == loglevel::critical) dump();
+	}
+
+	bool FlightRecorderLogOutput::dump(const char *note) const noexcept {
+		return m_ring->dump(m_fname.c_str(), note);
+	}
+
+	FlightRecorderLogOutput::~FlightRecorderLogOutput() {
+		for (auto &r : flight_recorders) {
+			FlightRecorderLogOutput *expected = this;
+			r.compare_exchange_strong(expected, nullptr);
+		}
+		flight_recorder_count--;
+	}
+
 	size_t LogInit::refcount = 0;
 
 	LogInit::LogInit() {
@@ -295,12 +1567,20 @@ namespace gecom {
 			// ensure log statics are initialized
 			logStatics();
 			Log::info() << "Log initialized";
+			if (const char *s = std::getenv("GECOM_LOG_ASYNC")) {
+				const std::string mode(s);
+				if (mode == "block" || mode == "drop") {
+					Log::startAsync(256 * 1024, mode == "drop" ? logoverflow::drop : logoverflow::block);
+					Log::info() << "Logging asynchronously [overflow=" << mode << "]";
+				}
+			}
 		}
 	}
 
 	LogInit::~LogInit() {
 		if (--refcount == 0) {
 			// log statics about to be destroyed
+			Log::stopAsync();
 			Log::info() << "Log deinitialized";
 		}
 	}
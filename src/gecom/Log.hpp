@@ -3,12 +3,16 @@
 
 #include <iostream>
 #include <iomanip>
+#include <atomic>
 #include <string>
 #include <sstream>
 #include <fstream>
 #include <unordered_set>
+#include <unordered_map>
+#include <vector>
 #include <chrono>
 #include <mutex>
+#include <memory>
 #include <stdexcept>
 #include <utility>
 
@@ -20,6 +24,9 @@
 
 namespace gecom {
 
+	class file_serializer;
+	class file_deserializer;
+
 	class LogInit {
 	private:
 		static size_t refcount;
@@ -53,6 +60,14 @@ namespace gecom {
 		return out;
 	}
 
+	// what asynchronous logging does when a thread's log buffer is full
+	enum class logoverflow {
+		// wait for the log writer thread to make space
+		block,
+		// discard the message; discarded messages are counted and reported
+		drop
+	};
+
 	template <typename CharT>
 	class basic_logstream;
 	
@@ -61,6 +76,7 @@ namespace gecom {
 	struct logmessage {
 		// RFC3339 time string https://www.ietf.org/rfc/rfc3339.txt
 		std::string time;
+		std::chrono::system_clock::time_point timestamp;
 		loglevel level;
 		unsigned verbosity;
 		std::string source;
@@ -81,8 +97,8 @@ namespace gecom {
 
 	class LogOutput {
 	private:
-		unsigned m_verbosity = 9001;
-		bool m_mute = false;
+		std::atomic<unsigned> m_verbosity { 9001 };
+		std::atomic<bool> m_mute { false };
 
 	protected:
 		// this is responsible for trailing newlines
@@ -95,25 +111,31 @@ namespace gecom {
 		LogOutput(bool mute_ = false) : m_mute(mute_) { }
 
 		unsigned verbosity() const {
-			return m_verbosity;
+			return m_verbosity.load(std::memory_order_relaxed);
 		}
 
-		void verbosity(unsigned v) {
-			m_verbosity = v;
-		}
+		// messages are written if their verbosity is less than this
+		void verbosity(unsigned v);
 
 		bool mute() const {
-			return m_mute;
+			return m_mute.load(std::memory_order_relaxed);
 		}
 
-		void mute(bool b) {
-			m_mute = b;
+		void mute(bool b);
+
+		// test if a message with this verbosity would be written
+		bool accepts(unsigned v) const {
+			return !mute() && v < verbosity();
 		}
 
 		void write(const logmessage &msg) {
-			if (!m_mute && msg.verbosity < m_verbosity) writeImpl(msg);
+			if (accepts(msg.verbosity)) writeImpl(msg);
 		}
 
+		// write out anything buffered.
+		// when logging asynchronously, this is called after each batch of messages.
+		virtual void flush() { }
+
 		virtual ~LogOutput() { }
 
 	};
@@ -156,23 +178,202 @@ namespace gecom {
 		}
 	};
 
+	// log output that writes a compact binary log, to be read with BinaryLogReader or gecom_logcat.
+	// each distinct source is written once per file and then referred to by index.
+	// the file is flushed on critical messages, after each batch when logging asynchronously,
+	// and on destruction, rather than after every message.
+	class BinaryLogOutput : public LogOutput {
+	private:
+		std::unique_ptr<file_serializer> m_out;
+		std::unordered_map<std::string, size_t> m_sources;
+
+	protected:
+		virtual void writeImpl(const logmessage &msg) override;
+
+	public:
+		// mode may include std::ios::app to append to an existing binary log
+		explicit BinaryLogOutput(
+			const std::string &fname_,
+			std::ios::openmode mode_ = std::ios::trunc,
+			bool mute_ = false
+		);
+
+		virtual void flush() override;
+
+		virtual ~BinaryLogOutput();
+	};
+
+	// log output that appends text to a memory-mapped file of fixed size; messages are formatted
+	// straight into the mapping, with no copies or system calls. when the file is full or older than max_age (if not zero),
+	// it is truncated to its contents and renamed to fname.1, older files moving up to fname.<keep>
+	// and the oldest being deleted. an existing file at fname is rotated out on construction.
+	// messages longer than a whole file are truncated.
+	class RotatingLogOutput : public LogOutput {
+	private:
+		class segment;
+
+		std::string m_fname;
+		size_t m_segment_size;
+		unsigned m_keep;
+		std::chrono::steady_clock::duration m_max_age;
+		std::unique_ptr<segment> m_segment;
+		std::chrono::steady_clock::time_point m_opened;
+		// end of the text in the current file; published after each message is written
+		std::atomic<size_t> m_tail { 0 };
+		// writes to the current file
+		std::ostream m_stream { nullptr };
+
+		std::string rotatedName(unsigned i) const;
+
+		// close the current file and shift the old ones
+		void rotate();
+
+		// start a new file
+		void open();
+
+	protected:
+		virtual void writeImpl(const logmessage &msg) override;
+
+	public:
+		explicit RotatingLogOutput(
+			const std::string &fname_,
+			size_t segment_size_ = 16 * 1024 * 1024,
+			unsigned keep_ = 4,
+			std::chrono::steady_clock::duration max_age_ = std::chrono::steady_clock::duration::zero(),
+			bool mute_ = false
+		);
+
+		// bytes written to the current file
+		size_t size() const {
+			return m_tail.load(std::memory_order_acquire);
+		}
+
+		virtual ~RotatingLogOutput();
+	};
+
+	// log output that keeps the most recent messages in a fixed-size ring in memory, unformatted;
+	// recording a message is a couple of memcpys. the ring is written as text to dump_fname when a critical message is logged, when dump() is called, and
+	// when the process dies from SIGSEGV, SIGABRT, SIGBUS, SIGILL or SIGFPE (or an unhandled exception
+	// on windows). it accepts every verbosity by default. when logging asynchronously, messages not yet
+	// taken by the log writer thread are lost if the process dies. threads that log get an alternate
+	// signal stack, so a stack overflow can be dumped too. at most 8 can exist at once.
+	class FlightRecorderLogOutput : public LogOutput {
+	private:
+		class ring;
+
+		std::unique_ptr<ring> m_ring;
+		std::string m_fname;
+
+	protected:
+		virtual void writeImpl(const logmessage &msg) override;
+
+	public:
+		// throws std::runtime_error if too many flight recorders exist
+		explicit FlightRecorderLogOutput(const std::string &dump_fname_, size_t size_ = 1024 * 1024, bool mute_ = false);
+
+		// write the recorded messages to the dump file, oldest first, followed by note (if any).
+		// this is async-signal-safe. returns false if the file can't be written.
+		bool dump(const char *note = nullptr) const noexcept;
+
+		virtual ~FlightRecorderLogOutput();
+	};
+
+	// reads messages from a log written by BinaryLogOutput
+	class BinaryLogReader {
+	private:
+		std::unique_ptr<file_deserializer> m_in;
+		std::vector<std::string> m_sources;
+
+	public:
+		// throws std::runtime_error if the file can't be opened or isn't a binary log
+		explicit BinaryLogReader(const std::string &fname_);
+
+		// read the next message; returns false at end of file.
+		// a truncated final record (e.g. after a crash) is treated as end of file.
+		// throws std::runtime_error if the log is corrupt.
+		bool read(logmessage &msg);
+
+		~BinaryLogReader();
+	};
+
 	class Log {
 	private:
 		Log() = delete;
 		Log(const Log &) = delete;
 		Log & operator=(const Log &) = delete;
 
+		// one more than the greatest verbosity any output accepts
+		static std::atomic<unsigned> s_verbosity_limit;
+
+		// incremented when outputs are added or removed or change their settings
+		static std::atomic<unsigned> s_outputs_changes;
+
+		// value of s_outputs_changes that s_verbosity_limit was computed for
+		static std::atomic<unsigned> s_limit_changes;
+
+		static bool enabledSlow(unsigned verbosity);
+
 	public:
 		static constexpr unsigned defaultVerbosity(loglevel l) {
 			return l == loglevel::critical ? 0 : (l == loglevel::error ? 1 : (l == loglevel::warning ? 2 : 3));
 		}
 		
+		// test if any output would accept a message with this verbosity.
+		// this is cheap enough to guard every logging call.
+		static bool enabled(unsigned verbosity) {
+			if (s_outputs_changes.load(std::memory_order_acquire) != s_limit_changes.load(std::memory_order_acquire)) {
+				return enabledSlow(verbosity);
+			}
+			return verbosity < s_verbosity_limit.load(std::memory_order_relaxed);
+		}
+
+		// outputs call this when their verbosity or mute state changes
+		static void outputsChanged() noexcept {
+			s_outputs_changes.fetch_add(1, std::memory_order_acq_rel);
+		}
+
+		// message source as written to outputs: pid/thread/section path/source/
+		static std::string fullSource(const std::string &source);
+
 		static void write(unsigned verbosity, loglevel level, const std::string &source, const std::string &body);
 
 		static void addOutput(LogOutput *);
 
 		static void removeOutput(LogOutput *);
 
+		// fold repeats of a thread's last message (same source and body) into a
+		// 'Last message repeated N times' message, written with the thread's next different
+		// message or every second while the repeats continue. on by default.
+		static void deduplicate(bool);
+
+		static bool deduplicate();
+
+		// limit each source to rate messages per second with bursts of up to burst messages.
+		// suppressed messages are counted and reported once the source is under the limit.
+		// rate <= 0 (the default) disables limiting. critical messages are never suppressed.
+		static void rateLimit(double rate, unsigned burst = 100);
+
+		// start writing log messages on a background thread.
+		// each logging thread copies its messages into its own buffer of buffer_size bytes,
+		// and formatting and output happen on the log writer thread. critical messages are
+		// written before the logging call returns. messages from one thread are written
+		// in order; messages from different threads are ordered by time within a batch.
+		// this can also be enabled by setting GECOM_LOG_ASYNC to 'block' or 'drop' (the overflow policy).
+		static void startAsync(size_t buffer_size = 256 * 1024, logoverflow overflow = logoverflow::block);
+
+		// write all queued messages, then return to writing synchronously
+		static void stopAsync();
+
+		// test if logging asynchronously
+		static bool async();
+
+		// returns once all messages logged before the call have been written and outputs flushed
+		static void flush();
+
+		// true while the log writer thread is writing a batch of messages;
+		// outputs can defer flushing until flush() is called.
+		static bool batching();
+
 		// stdout starts muted
 		static LogOutput * stdOut();
 
@@ -192,6 +393,10 @@ namespace gecom {
 
 	};
 	
+	// stream for a single log message, written to the log on destruction.
+	// while no output would accept the message at its current verbosity, the stream
+	// discards anything written to it without formatting. set the level and verbosity
+	// before writing the message.
 	template <typename CharT>
 	class basic_logstream : public std::basic_ostream<CharT> {
 	private:
@@ -201,6 +406,16 @@ namespace gecom {
 		std::basic_stringbuf<CharT> m_buf;
 		bool m_write;
 
+		// start or stop formatting depending on whether the message would be written
+		void update() {
+			if (Log::enabled(m_verbosity)) {
+				if (!this->rdbuf()) this->rdbuf(&m_buf);
+			} else if (this->rdbuf()) {
+				// null streambuf sets badbit, so insertions do nothing
+				this->rdbuf(nullptr);
+			}
+		}
+
 	public:
 		basic_logstream(const basic_logstream &) = delete;
 		basic_logstream & operator=(const basic_logstream &) = delete;
@@ -212,11 +427,13 @@ namespace gecom {
 			m_level(loglevel::info),
 			m_source(std::move(source_)),
 			m_write(true)
-		{ }
+		{
+			update();
+		}
 
 		// move ctor; takes over responsibility for writing to log
 		basic_logstream(basic_logstream &&other) :
-			std::basic_ostream<CharT>(&m_buf),
+			std::basic_ostream<CharT>(other.rdbuf() ? &m_buf : nullptr),
 			m_verbosity(other.m_verbosity),
 			m_level(other.m_level),
 			m_source(std::move(other.m_source)),
@@ -231,6 +448,7 @@ namespace gecom {
 		basic_logstream & info(unsigned v = Log::defaultVerbosity(loglevel::info)) {
 			m_level = loglevel::info;
 			m_verbosity = v;
+			update();
 			return *this;
 		}
 
@@ -238,6 +456,7 @@ namespace gecom {
 		basic_logstream & warning(unsigned v = Log::defaultVerbosity(loglevel::warning)) {
 			m_level = loglevel::warning;
 			m_verbosity = v;
+			update();
 			return *this;
 		}
 
@@ -245,6 +464,7 @@ namespace gecom {
 		basic_logstream & error(unsigned v = Log::defaultVerbosity(loglevel::error)) {
 			m_level = loglevel::error;
 			m_verbosity = v;
+			update();
 			return *this;
 		}
 
@@ -252,24 +472,29 @@ namespace gecom {
 		basic_logstream & critical(unsigned v = Log::defaultVerbosity(loglevel::critical)) {
 			m_level = loglevel::critical;
 			m_verbosity = v;
+			update();
 			return *this;
 		}
 
 		// set verbosity
 		basic_logstream & verbosity(unsigned v) {
 			m_verbosity = v;
+			update();
 			return *this;
 		}
 
 		// set verbosity as default verbosity for a loglevel
 		basic_logstream & verbosity(loglevel l) {
 			m_verbosity = Log::defaultVerbosity(l);
+			update();
 			return *this;
 		}
 
+		// the source is expanded (with the thread and section of the destroying thread)
+		// only here, once the final verbosity is known
 		~basic_logstream() {
-			if (m_write) {
-				Log::write(m_verbosity, m_level, m_source, m_buf.str());
+			if (m_write && this->rdbuf()) {
+				Log::write(m_verbosity, m_level, Log::fullSource(m_source), m_buf.str());
 			}
 		}
 
@@ -277,6 +502,23 @@ namespace gecom {
 
 }
 
+// messages logged through these macros with verbosity >= GECOM_LOG_MAX_VERBOSITY are compiled out
+#ifndef GECOM_LOG_MAX_VERBOSITY
+#define GECOM_LOG_MAX_VERBOSITY 9001
+#endif
+
+// log a message only if some output would accept it. otherwise, neither the log stream
+// nor anything written to it is evaluated. usage: GECOM_LOG(warning, 2, "Source") << "foo";
+#define GECOM_LOG(level, verbosity, source) \
+	if (!((verbosity) < GECOM_LOG_MAX_VERBOSITY && ::gecom::Log::enabled(verbosity))) { } \
+	else ::gecom::Log::info(source).level(verbosity)
+
+// log at the default verbosity for a level
+#define GECOM_LOG_INFO(source) GECOM_LOG(info, ::gecom::Log::defaultVerbosity(::gecom::loglevel::info), source)
+#define GECOM_LOG_WARNING(source) GECOM_LOG(warning, ::gecom::Log::defaultVerbosity(::gecom::loglevel::warning), source)
+#define GECOM_LOG_ERROR(source) GECOM_LOG(error, ::gecom::Log::defaultVerbosity(::gecom::loglevel::error), source)
+#define GECOM_LOG_CRITICAL(source) GECOM_LOG(critical, ::gecom::Log::defaultVerbosity(::gecom::loglevel::critical), source)
+
 namespace {
 	gecom::LogInit log_init_obj;
 }
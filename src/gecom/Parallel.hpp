@@ -0,0 +1,275 @@
+/*
+ * GECom Data-Parallel Algorithms Header
+ *
+ * Fork-join algorithms on the background task scheduler. Work is split
+ * recursively; at each split one half is offered to the scheduler as a task
+ * and the calling thread continues with the other. When the calling thread
+ * finishes its half it takes the offered half back if no worker has started
+ * it yet, so these never wait on queued work and are safe to call from
+ * inside background tasks, even with a concurrency of 1.
+ */
+
+#ifndef GECOM_PARALLEL_HPP
+#define GECOM_PARALLEL_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <iterator>
+#include <algorithm>
+#include <numeric>
+#include <functional>
+#include <vector>
+#include <utility>
+#include <type_traits>
+
+#include "Concurrent.hpp"
+
+namespace gecom {
+
+	namespace async {
+
+		namespace detail {
+
+			// half of a fork offered to the scheduler
+			class fork_chunk : private Uncopyable {
+			private:
+				// 0: pending, 1: claimed, 2: finished
+				std::atomic<int> m_state { 0 };
+				std::mutex m_mutex;
+				std::condition_variable m_cond;
+				std::exception_ptr m_exception;
+
+			public:
+				fork_chunk() { }
+
+				// returns true if the caller should run the chunk
+				bool claim() noexcept {
+					int expected = 0;
+					return m_state.compare_exchange_strong(expected, 1);
+				}
+
+				template <typename FunT>
+				void run(FunT &fun) noexcept {
+					try {
+						fun();
+					} catch (...) {
+						m_exception = std::current_exception();
+					}
+				}
+
+				void finish() {
+					{
+						std::unique_lock<std::mutex> lock(m_mutex);
+						m_state = 2;
+					}
+					m_cond.notify_all();
+				}
+
+				void wait() {
+					if (m_state == 2) return;
+					std::unique_lock<std::mutex> lock(m_mutex);
+					while (m_state != 2) {
+						m_cond.wait(lock);
+					}
+				}
+
+				void rethrow() const {
+					if (m_exception) std::rethrow_exception(m_exception);
+				}
+			};
+
+			// default grain: enough chunks to balance load without drowning in forks
+			inline size_t default_grain(size_t count, size_t mingrain = 1) {
+				return std::max(mingrain, count / (8 * concurrency()));
+			}
+
+		}
+
+		// run two functions, potentially in parallel; returns when both have finished.
+		// the second function is offered to the background scheduler with the specified deadline.
+		// if either function throws, the exception is rethrown after both have finished.
+		template <typename FunAT, typename FunBT>
+		inline void parallel_invoke(clock::time_point deadline, FunAT &&a, FunBT &&b) {
+			auto chunk = std::allocate_shared<detail::fork_chunk>(detail::pool_allocator<detail::fork_chunk>());
+			auto pb = std::addressof(b);
+			// the task only touches b if it claims the chunk, in which case we wait for it
+			detail::invoke(std::thread::id(), deadline, detail::make_callable_runnable([chunk, pb]() {
+				if (chunk->claim()) {
+					chunk->run(*pb);
+					chunk->finish();
+				}
+			}));
+			std::exception_ptr ea;
+			try {
+				a();
+			} catch (...) {
+				ea = std::current_exception();
+			}
+			if (chunk->claim()) {
+				// nobody started b, run it here
+				chunk->run(b);
+			} else {
+				chunk->wait();
+			}
+			if (ea) std::rethrow_exception(ea);
+			chunk->rethrow();
+		}
+
+		// run two functions, potentially in parallel (immediate deadline)
+		template <typename FunAT, typename FunBT>
+		inline void parallel_invoke(FunAT &&a, FunBT &&b) {
+			parallel_invoke(clock::now(), std::forward<FunAT>(a), std::forward<FunBT>(b));
+		}
+
+		namespace detail {
+
+			template <typename IndexT, typename FunT>
+			inline void parallel_for_impl(IndexT first, IndexT last, FunT &fun, size_t grain, clock::time_point deadline) {
+				if (size_t(last - first) > grain) {
+					IndexT mid = first + (last - first) / 2;
+					parallel_invoke(
+						deadline,
+						[&]() { parallel_for_impl(first, mid, fun, grain, deadline); },
+						[&]() { parallel_for_impl(mid, last, fun, grain, deadline); }
+					);
+				} else {
+					for (; first != last; ++first) {
+						fun(first);
+					}
+				}
+			}
+
+			template <typename IndexT, typename T, typename MapT, typename ReduceT>
+			inline T parallel_reduce_impl(IndexT first, IndexT last, const T &identity, MapT &map, ReduceT &reduce, size_t grain, clock::time_point deadline) {
+				if (size_t(last - first) > grain) {
+					IndexT mid = first + (last - first) / 2;
+					T a = identity;
+					T b = identity;
+					parallel_invoke(
+						deadline,
+						[&]() { a = parallel_reduce_impl(first, mid, identity, map, reduce, grain, deadline); },
+						[&]() { b = parallel_reduce_impl(mid, last, identity, map, reduce, grain, deadline); }
+					);
+					return reduce(std::move(a), std::move(b));
+				} else {
+					T r = identity;
+					for (; first != last; ++first) {
+						r = reduce(std::move(r), map(first));
+					}
+					return r;
+				}
+			}
+
+			// depth is the remaining partition budget; once exhausted (adversarial input),
+			// the range is left to std::sort, which is O(n log n) in the worst case
+			template <typename RandItT, typename CompareT>
+			inline void parallel_sort_impl(RandItT first, RandItT last, CompareT &comp, size_t grain, size_t depth, clock::time_point deadline) {
+				if (size_t(last - first) > grain && depth) {
+					// median-of-three pivot
+					RandItT mid = first + (last - first) / 2;
+					RandItT back = last - 1;
+					if (comp(*mid, *first)) std::iter_swap(mid, first);
+					if (comp(*back, *mid)) std::iter_swap(back, mid);
+					if (comp(*mid, *first)) std::iter_swap(mid, first);
+					const auto pivot = *mid;
+					// 3-way partition: [less][equal][greater]
+					RandItT m1 = std::partition(first, last, [&](const auto &x) { return comp(x, pivot); });
+					RandItT m2 = std::partition(m1, last, [&](const auto &x) { return !comp(pivot, x); });
+					parallel_invoke(
+						deadline,
+						[&]() { parallel_sort_impl(first, m1, comp, grain, depth - 1, deadline); },
+						[&]() { parallel_sort_impl(m2, last, comp, grain, depth - 1, deadline); }
+					);
+				} else {
+					std::sort(first, last, comp);
+				}
+			}
+
+		}
+
+		// call fun(i) for each i in [first, last), in parallel.
+		// IndexT can be an integer or random-access iterator type.
+		// ranges of at most grain elements are run sequentially; 0 chooses automatically.
+		template <typename IndexT, typename FunT>
+		inline void parallel_for(IndexT first, IndexT last, FunT &&fun, size_t grain = 0, clock::time_point deadline = clock::now()) {
+			if (!(first < last)) return;
+			const size_t count = last - first;
+			grain = grain ? grain : detail::default_grain(count);
+			detail::parallel_for_impl(first, last, fun, grain, deadline);
+		}
+
+		// reduce map(i) for each i in [first, last) with an associative operation, in parallel.
+		// elements are combined in order, so reduce need not be commutative.
+		// ranges of at most grain elements are reduced sequentially; 0 chooses automatically.
+		template <typename IndexT, typename T, typename MapT, typename ReduceT>
+		inline T parallel_reduce(IndexT first, IndexT last, T identity, MapT &&map, ReduceT &&reduce, size_t grain = 0, clock::time_point deadline = clock::now()) {
+			if (!(first < last)) return identity;
+			const size_t count = last - first;
+			grain = grain ? grain : detail::default_grain(count);
+			return detail::parallel_reduce_impl(first, last, identity, map, reduce, grain, deadline);
+		}
+
+		// inclusive prefix scan of [first, last) into [out, out + (last - first)) with an associative operation.
+		// in-place (out == first) is allowed. blocks of grain elements are scanned sequentially; 0 chooses automatically.
+		template <typename RandItT, typename OutItT, typename OpT = std::plus<>>
+		inline void parallel_scan(RandItT first, RandItT last, OutItT out, OpT &&op = OpT(), size_t grain = 0, clock::time_point deadline = clock::now()) {
+			using value_t = typename std::iterator_traits<RandItT>::value_type;
+			if (!(first < last)) return;
+			const size_t count = last - first;
+			grain = grain ? grain : detail::default_grain(count, 256);
+			const size_t blocks = (count + grain - 1) / grain;
+			if (blocks == 1) {
+				std::partial_sum(first, last, out, op);
+				return;
+			}
+			// reduce each block except the last
+			std::vector<value_t> sums(blocks - 1);
+			parallel_for(size_t(0), blocks - 1, [&](size_t k) {
+				RandItT it = first + k * grain;
+				RandItT end = it + grain;
+				value_t s = *it;
+				for (++it; it != end; ++it) {
+					s = op(std::move(s), *it);
+				}
+				sums[k] = std::move(s);
+			}, 1, deadline);
+			// scan block sums to get each block's carry-in
+			std::partial_sum(sums.begin(), sums.end(), sums.begin(), op);
+			// scan each block with its carry-in
+			parallel_for(size_t(0), blocks, [&](size_t k) {
+				RandItT it = first + k * grain;
+				RandItT end = first + std::min(count, (k + 1) * grain);
+				OutItT o = out + k * grain;
+				value_t s = k ? op(sums[k - 1], *it) : value_t(*it);
+				*o = s;
+				for (++it, ++o; it != end; ++it, ++o) {
+					s = op(std::move(s), *it);
+					*o = s;
+				}
+			}, 1, deadline);
+		}
+
+		// sort [first, last), in parallel. not stable. O(n log n) work even for adversarial input:
+		// past 2 log2(n) levels of partitioning, subranges fall back to std::sort.
+		// ranges of at most grain elements are sorted sequentially; 0 chooses automatically.
+		template <typename RandItT, typename CompareT = std::less<>>
+		inline void parallel_sort(RandItT first, RandItT last, CompareT &&comp = CompareT(), size_t grain = 0, clock::time_point deadline = clock::now()) {
+			if (!(first < last)) return;
+			const size_t count = last - first;
+			grain = grain ? grain : detail::default_grain(count, 2048);
+			// introsort-style depth limit of 2 log2(n)
+			size_t depth = 0;
+			for (size_t n = count; n > 1; n >>= 1) depth += 2;
+			detail::parallel_sort_impl(first, last, comp, grain, depth, deadline);
+		}
+
+	}
+
+}
+
+#endif // GECOM_PARALLEL_HPP
@@ -4,6 +4,7 @@
 
 #include <cassert>
 #include <cstdint>
+#include <cstring>
 #include <climits>
 #include <type_traits>
 #include <string>
@@ -63,7 +64,7 @@ namespace gecom {
 	class serializer_base {
 	public:
 		using iostate = std::ios_base::iostate;
-		static constexpr iostate goodbit = 0;
+		static constexpr iostate goodbit = iostate(0);
 		static constexpr iostate badbit = std::ios_base::badbit;
 		static constexpr iostate failbit = std::ios_base::failbit;
 		static constexpr iostate eofbit = std::ios_base::eofbit;
@@ -219,14 +220,16 @@ namespace gecom {
 
 		void putFloat(float x) {
 			static_assert(sizeof(float) == sizeof(uint32_t), "assumed sizeof(float) == sizeof(uint32_t)");
-			uint32_t x2 = reinterpret_cast<uint32_t &>(x);
+			uint32_t x2;
+			std::memcpy(&x2, &x, sizeof(x2));
 			x2 = m_endianness == fpuEndian() ? x2 : intrin::byteSwap(x2);
 			write(reinterpret_cast<char *>(&x2), sizeof(uint32_t));
 		}
 
 		void putDouble(double x) {
 			static_assert(sizeof(double) == sizeof(uint64_t), "assumed sizeof(double) == sizeof(uint64_t)");
-			uint64_t x2 = reinterpret_cast<uint64_t &>(x);
+			uint64_t x2;
+			std::memcpy(&x2, &x, sizeof(x2));
 			x2 = m_endianness == fpuEndian() ? x2 : intrin::byteSwap(x2);
 			write(reinterpret_cast<char *>(&x2), sizeof(uint64_t));
 		}
@@ -289,7 +292,7 @@ namespace gecom {
 			template <typename TupleT>
 			static void go(serializer &out, const TupleT &tup) {
 				out << std::get<(std::tuple_size<TupleT>::value - Remaining)>(tup);
-				serialize_tuple_impl<Remaining - 1>(out, tup);
+				serialize_tuple_impl<Remaining - 1>::go(out, tup);
 			}
 		};
 
@@ -459,7 +462,7 @@ namespace gecom {
 			} else {
 				// read specified number of bytes, little-endian
 				size_t x = 0;
-				assert((c <= 247 + sizeof(size_t)) && "size_t not big enough");
+				assert((size_t(c) <= 247 + sizeof(size_t)) && "size_t not big enough");
 				read(reinterpret_cast<char *>(&x), c - 247);
 				x = cpuEndian() == endian::little ? x : intrin::byteSwap(x);
 				return x;
@@ -471,7 +474,9 @@ namespace gecom {
 			uint32_t x2 = 0;
 			read(reinterpret_cast<char *>(&x2), sizeof(uint32_t));
 			x2 = m_endianness == fpuEndian() ? x2 : intrin::byteSwap(x2);
-			return reinterpret_cast<float &>(x2);
+			float x;
+			std::memcpy(&x, &x2, sizeof(x));
+			return x;
 		}
 
 		double getDouble() {
@@ -479,7 +484,9 @@ namespace gecom {
 			uint64_t x2 = 0;
 			read(reinterpret_cast<char *>(&x2), sizeof(uint64_t));
 			x2 = m_endianness == fpuEndian() ? x2 : intrin::byteSwap(x2);
-			return reinterpret_cast<double &>(x2);
+			double x;
+			std::memcpy(&x, &x2, sizeof(x));
+			return x;
 		}
 
 		template <typename IntT, typename = std::enable_if_t<std::is_integral<IntT>::value>>
@@ -542,7 +549,7 @@ namespace gecom {
 			template <typename TupleT>
 			static void go(deserializer &in, TupleT &tup) {
 				in >> std::get<(std::tuple_size<TupleT>::value - Remaining)>(tup);
-				deserialize_tuple_impl<Remaining - 1>(out, tup);
+				deserialize_tuple_impl<Remaining - 1>::go(in, tup);
 			}
 		};
 
@@ -650,6 +657,7 @@ namespace gecom {
 			in >> x;
 			v.insert(std::move(x));
 		}
+		return in;
 	}
 
 	template <typename T, typename HashT, typename KeyEqT, typename AllocT>
@@ -661,6 +669,7 @@ namespace gecom {
 			in >> x;
 			v.insert(std::move(x));
 		}
+		return in;
 	}
 
 	template <typename KeyT, typename ValueT, typename PredT, typename AllocT>
@@ -0,0 +1,255 @@
+/*
+ * GECom Task Graph Header
+ *
+ * Reusable task dependency graphs. Nodes and edges are declared once; each run
+ * resets per-node dependency counters and submits nodes to the task engine as
+ * their predecessors complete. Affinitized nodes (e.g. main thread) are run by
+ * async::execute() on their thread. A run allocates nothing from the global heap
+ * in steady state, so a graph can be kept and re-run every frame.
+ */
+
+#ifndef GECOM_TASKGRAPH_HPP
+#define GECOM_TASKGRAPH_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <atomic>
+#include <exception>
+#include <stdexcept>
+#include <future>
+#include <functional>
+#include <deque>
+#include <vector>
+#include <utility>
+
+#include "Concurrent.hpp"
+#include "Future.hpp"
+
+namespace gecom {
+
+	namespace async {
+
+		// a reusable graph of tasks with dependencies.
+		// the graph must not be modified or destroyed while a run is in progress,
+		// and only one run may be in progress at a time.
+		class task_graph : private Uncopyable {
+		public:
+			using node_id = size_t;
+
+		private:
+			struct node {
+				std::function<void()> fun;
+				std::thread::id affinity;
+				std::vector<node_id> successors;
+				size_t predecessors = 0;
+				std::atomic<size_t> remaining { 0 };
+
+				node(std::thread::id affinity_, std::function<void()> fun_) : fun(std::move(fun_)), affinity(affinity_) { }
+			};
+
+			// deque: nodes don't move when more are added
+			std::deque<node> m_nodes;
+			std::vector<node_id> m_roots;
+			bool m_validated = false;
+
+			// per-run state
+			std::atomic<bool> m_running { false };
+			std::atomic<size_t> m_pending { 0 };
+			std::atomic<bool> m_failed { false };
+			std::exception_ptr m_exception;
+			clock::time_point m_deadline;
+			promise<void> m_promise;
+
+			// check for cycles and find the root nodes
+			void validate() {
+				m_roots.clear();
+				std::vector<size_t> indegree(m_nodes.size());
+				for (node_id i = 0; i < m_nodes.size(); i++) {
+					indegree[i] = m_nodes[i].predecessors;
+					if (!indegree[i]) m_roots.push_back(i);
+				}
+				// kahn's algorithm; every node must be reached
+				std::vector<node_id> open(m_roots);
+				size_t reached = 0;
+				while (!open.empty()) {
+					node_id i = open.back();
+					open.pop_back();
+					reached++;
+					for (node_id j : m_nodes[i].successors) {
+						if (!--indegree[j]) open.push_back(j);
+					}
+				}
+				if (reached != m_nodes.size()) throw std::logic_error("task graph contains a cycle");
+				m_validated = true;
+			}
+
+			// a node's task. if it is destroyed without running (dropped at scheduler shutdown),
+			// the node is discarded so the run still completes.
+			class node_task {
+			private:
+				task_graph *m_graph;
+				node_id m_i;
+
+			public:
+				node_task(task_graph *graph_, node_id i_) : m_graph(graph_), m_i(i_) { }
+
+				node_task(node_task &&other) noexcept : m_graph(other.m_graph), m_i(other.m_i) {
+					other.m_graph = nullptr;
+				}
+
+				void operator()() {
+					std::exchange(m_graph, nullptr)->runNode(m_i);
+				}
+
+				~node_task() {
+					if (m_graph) m_graph->discardNode(m_i);
+				}
+			};
+
+			void submit(node_id i) {
+				detail::invoke(m_nodes[i].affinity, m_deadline, detail::make_callable_runnable(node_task(this, i)));
+			}
+
+			void runNode(node_id i) {
+				node &n = m_nodes[i];
+				// after a failure, remaining nodes are skipped but still released in order
+				if (!m_failed.load(std::memory_order_relaxed)) {
+					try {
+						n.fun();
+					} catch (...) {
+						if (!m_failed.exchange(true)) m_exception = std::current_exception();
+					}
+				}
+				for (node_id j : n.successors) {
+					if (m_nodes[j].remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) submit(j);
+				}
+				if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) finish();
+			}
+
+			// a node that will never run fails the run, and its successors waiting only on it
+			// (and so on) are discarded too rather than submitted
+			void discardNode(node_id i) noexcept {
+				if (!m_failed.exchange(true)) {
+					m_exception = std::make_exception_ptr(std::future_error(std::future_errc::broken_promise));
+				}
+				std::vector<node_id> open { i };
+				size_t discarded = 0;
+				while (!open.empty()) {
+					const node_id j = open.back();
+					open.pop_back();
+					discarded++;
+					for (node_id k : m_nodes[j].successors) {
+						if (m_nodes[k].remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) open.push_back(k);
+					}
+				}
+				if (m_pending.fetch_sub(discarded, std::memory_order_acq_rel) == discarded) finish();
+			}
+
+			void finish() {
+				// the graph may be re-run or destroyed as soon as the promise is satisfied
+				promise<void> p = std::move(m_promise);
+				std::exception_ptr e = std::move(m_exception);
+				m_running = false;
+				if (e) {
+					p.set_exception(std::move(e));
+				} else {
+					p.set_value();
+				}
+			}
+
+		public:
+			task_graph() { }
+
+			// add a node to be run on an affinitized scheduler
+			template <typename FunT>
+			node_id add(std::thread::id affinity, FunT &&fun) {
+				assert(!m_running);
+				m_nodes.emplace_back(affinity, std::forward<FunT>(fun));
+				m_validated = false;
+				return m_nodes.size() - 1;
+			}
+
+			// add a node to be run on the background scheduler
+			template <typename FunT>
+			node_id add(FunT &&fun) {
+				return add(std::thread::id(), std::forward<FunT>(fun));
+			}
+
+			// add a node to be run on the main thread
+			template <typename FunT>
+			node_id addMain(FunT &&fun) {
+				return add(mainThreadId(), std::forward<FunT>(fun));
+			}
+
+			// node a must finish before node b starts
+			void precede(node_id a, node_id b) {
+				assert(!m_running);
+				assert(a < m_nodes.size() && b < m_nodes.size());
+				m_nodes[a].successors.push_back(b);
+				m_nodes[b].predecessors++;
+				m_validated = false;
+			}
+
+			size_t size() const noexcept {
+				return m_nodes.size();
+			}
+
+			bool running() const noexcept {
+				return m_running;
+			}
+
+			void clear() {
+				assert(!m_running);
+				m_nodes.clear();
+				m_roots.clear();
+				m_validated = false;
+			}
+
+			// run the graph (absolute deadline for all nodes).
+			// returns a future that becomes ready once every node has run. if any node throws,
+			// nodes not yet started are skipped and the first exception is stored in the future.
+			// if a node's task is dropped without running (scheduler shutdown), its successors are
+			// skipped too and the future reports std::future_error (broken_promise).
+			// if the graph has affinitized nodes, their threads must call async::execute() for it to complete.
+			// throws std::logic_error if the graph contains a cycle.
+			future<void> run(clock::time_point deadline) {
+				if (m_running.exchange(true)) throw std::logic_error("task graph is already running");
+				try {
+					if (!m_validated) validate();
+				} catch (...) {
+					m_running = false;
+					throw;
+				}
+				m_promise = promise<void>();
+				auto f = m_promise.get_future();
+				if (m_nodes.empty()) {
+					finish();
+					return f;
+				}
+				for (auto &n : m_nodes) {
+					n.remaining.store(n.predecessors, std::memory_order_relaxed);
+				}
+				m_failed.store(false, std::memory_order_relaxed);
+				m_deadline = deadline;
+				m_pending.store(m_nodes.size(), std::memory_order_release);
+				for (node_id i : m_roots) {
+					submit(i);
+				}
+				return f;
+			}
+
+			// run the graph (relative deadline for all nodes)
+			future<void> run(clock::duration deadline) {
+				return run(clock::now() + deadline);
+			}
+
+			~task_graph() {
+				assert(!m_running);
+			}
+		};
+
+	}
+
+}
+
+#endif // GECOM_TASKGRAPH_HPP
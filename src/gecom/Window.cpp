@@ -14,10 +14,132 @@ namespace gecom {
 
 	namespace {
 
+		// global event posted from some thread, awaiting dispatch on the main thread.
+		// the event is stored after the header.
+		struct alignas(max_align_t) posted_event {
+			atomic<posted_event *> next { nullptr };
+			window_event *event = nullptr;
+			size_t capacity = 0;
+
+			void * storage() {
+				return this + 1;
+			}
+
+			static posted_event * fromStorage(void *p) {
+				return reinterpret_cast<posted_event *>(p) - 1;
+			}
+
+			static posted_event * make(size_t capacity) {
+				posted_event *n = new (::operator new(sizeof(posted_event) + capacity)) posted_event();
+				n->capacity = capacity;
+				return n;
+			}
+
+			static void release(posted_event *n) {
+				n->~posted_event();
+				::operator delete(n);
+			}
+		};
+
+		// storage for any of the builtin events; larger events get their own nodes
+		constexpr size_t posted_event_capacity = max({
+			sizeof(window_refresh_event), sizeof(window_close_event), sizeof(window_pos_event),
+			sizeof(window_size_event), sizeof(framebuffer_size_event), sizeof(window_focus_event),
+			sizeof(window_icon_event), sizeof(mouse_event), sizeof(mouse_button_event),
+			sizeof(mouse_scroll_event), sizeof(key_event), sizeof(char_event), sizeof(joystick_event),
+			sizeof(joystick_presence_event), sizeof(joystick_button_event)
+		});
+
+		// intrusive multi-producer single-consumer queue of posted events.
+		// producers only swap the head, so posting never waits for the main thread or other posters.
+		class posted_event_queue : private Uncopyable {
+		private:
+			// most recently posted
+			atomic<posted_event *> m_head;
+			// next to dispatch; main thread only
+			posted_event *m_tail;
+			posted_event m_stub;
+			// reusable nodes of posted_event_capacity
+			mpmc_ring<posted_event *> m_free { 256 };
+			// events pushed and popped, for bounding a drain
+			atomic<size_t> m_pushed { 0 };
+			size_t m_popped = 0;
+
+			void pushNode(posted_event *n) {
+				n->next.store(nullptr, memory_order_relaxed);
+				posted_event *prev = m_head.exchange(n, memory_order_acq_rel);
+				// consumer can't see n until this, so it stops at prev until then
+				prev->next.store(n, memory_order_release);
+			}
+
+		public:
+			posted_event_queue() : m_head(&m_stub), m_tail(&m_stub) { }
+
+			posted_event * alloc(size_t size) {
+				posted_event *n = nullptr;
+				if (size <= posted_event_capacity && m_free.try_pop(n)) return n;
+				return posted_event::make(max(size, posted_event_capacity));
+			}
+
+			void free(posted_event *n) {
+				if (n->capacity == posted_event_capacity && m_free.try_push(n)) return;
+				posted_event::release(n);
+			}
+
+			void push(posted_event *n) {
+				pushNode(n);
+				m_pushed.fetch_add(1, memory_order_relaxed);
+			}
+
+			// main thread only. null if empty, or if the next event is still being posted.
+			posted_event * pop() {
+				posted_event *tail = m_tail;
+				posted_event *next = tail->next.load(memory_order_acquire);
+				if (tail == &m_stub) {
+					if (!next) return nullptr;
+					m_tail = tail = next;
+					next = next->next.load(memory_order_acquire);
+				}
+				if (next) {
+					m_tail = next;
+					m_popped++;
+					return tail;
+				}
+				// tail is the last node, unless a post is in progress
+				if (tail != m_head.load(memory_order_acquire)) return nullptr;
+				// put the stub back so tail can be removed
+				pushNode(&m_stub);
+				next = tail->next.load(memory_order_acquire);
+				if (next) {
+					m_tail = next;
+					m_popped++;
+					return tail;
+				}
+				return nullptr;
+			}
+
+			// main thread only. upper bound on the number of events pop() can currently return.
+			size_t pending() const {
+				return m_pushed.load(memory_order_relaxed) - m_popped;
+			}
+
+			~posted_event_queue() {
+				while (posted_event *n = pop()) {
+					n->event->~window_event();
+					posted_event::release(n);
+				}
+				posted_event *n = nullptr;
+				while (m_free.try_pop(n)) {
+					posted_event::release(n);
+				}
+			}
+		};
+
 		struct WindowStatics {
 			Event<window_event> onGlobalEvent;
 			atomic<uintmax_t> next_event_uid { 1 };
 			joystick_state joystates[GLFW_JOYSTICK_LAST + 1];
+			posted_event_queue posted_events;
 		};
 
 		auto & windowStatics() {
@@ -305,39 +427,41 @@ namespace gecom {
 				auto logs = Log::info(log_source);
 
 				// message type -> log type
+				// level and verbosity are set before writing, so filtered messages aren't formatted
+				const char *type_name = "";
 				switch (type) {
 				case GL_DEBUG_TYPE_ERROR:
 					logs.error();
-					logs << "Error";
+					type_name = "Error";
 					exceptional = true;
 					break;
 				case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR:
 					logs.warning();
-					logs << "Deprecated Behaviour";
+					type_name = "Deprecated Behaviour";
 					break;
 				case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:
 					logs.warning();
-					logs << "Undefined Behaviour";
+					type_name = "Undefined Behaviour";
 					break;
 				case GL_DEBUG_TYPE_PORTABILITY:
 					logs.warning();
-					logs << "Portability";
+					type_name = "Portability";
 					break;
 				case GL_DEBUG_TYPE_PERFORMANCE:
 					logs.warning();
-					logs << "Performance";
+					type_name = "Performance";
 					break;
 				case GL_DEBUG_TYPE_MARKER:
-					logs << "Marker";
+					type_name = "Marker";
 					break;
 				case GL_DEBUG_TYPE_PUSH_GROUP:
-					logs << "Push Group";
+					type_name = "Push Group";
 					break;
 				case GL_DEBUG_TYPE_POP_GROUP:
-					logs << "Pop Group";
+					type_name = "Pop Group";
 					break;
 				case GL_DEBUG_TYPE_OTHER:
-					logs << "Other";
+					type_name = "Other";
 					break;
 				}
 
@@ -358,7 +482,7 @@ namespace gecom {
 				}
 
 				// actual message. id = as returned by glGetError(), in some cases
-				logs << " [" << id << "] : " << message;
+				logs << type_name << " [" << id << "] : " << message;
 
 			}
 
@@ -653,6 +777,40 @@ namespace gecom {
 		assertMainThread();
 		glfwPollEvents();
 		pollJoystickEvents();
+		dispatchPostedEvents();
+	}
+
+	void * Window::allocPostedEvent(size_t size) {
+		return windowStatics().posted_events.alloc(size)->storage();
+	}
+
+	void Window::freePostedEvent(void *storage) {
+		windowStatics().posted_events.free(posted_event::fromStorage(storage));
+	}
+
+	void Window::commitPostedEvent(void *storage, window_event *e) {
+		posted_event *n = posted_event::fromStorage(storage);
+		n->event = e;
+		windowStatics().posted_events.push(n);
+	}
+
+	void Window::dispatchPostedEvents() {
+		assertMainThread();
+		auto &q = windowStatics().posted_events;
+		// don't dispatch events posted by observers during this batch until the next poll
+		for (size_t count = q.pending(); count--; ) {
+			posted_event *n = q.pop();
+			if (!n) break;
+			// release the event even if an observer throws
+			auto release = [&](posted_event *p) {
+				p->event->~window_event();
+				q.free(p);
+			};
+			unique_ptr<posted_event, decltype(release)> guard(n, release);
+			// proxies ignore events with old uids, so this must be stamped now
+			n->event->euid = makeWindowEventUID();
+			dispatchGlobalEvent(*n->event);
+		}
 	}
 
 	create_window_args::operator Window * () {
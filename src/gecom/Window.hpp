@@ -10,12 +10,15 @@
 #ifndef GECOM_WINDOW_HPP
 #define GECOM_WINDOW_HPP
 
+#include <cstddef>
 #include <cstdint>
+#include <new>
 #include <string>
 #include <stdexcept>
 #include <unordered_map>
 #include <memory>
 #include <utility>
+#include <type_traits>
 #include <bitset>
 #include <array>
 
@@ -469,6 +472,7 @@ namespace gecom {
 
 	// handles dispatched events and forwards them to subscribers
 	// not actually thread-safe at the moment, so keep event dispatch to the main thread.
+	// other threads can use Window::postGlobalEvent().
 	class WindowEventProxy : public WindowEventDispatcher, private Uncopyable {
 	protected:
 		std::bitset<GLFW_KEY_LAST + 1> m_keystates;
@@ -622,6 +626,15 @@ namespace gecom {
 		void initialize();
 		void destroy();
 
+		// storage for an event to be posted, size bytes aligned for max_align_t
+		static void * allocPostedEvent(size_t size);
+		// release storage for an event that was not posted
+		static void freePostedEvent(void *storage);
+		// queue a constructed event for dispatch; e is the event in storage
+		static void commitPostedEvent(void *storage, window_event *e);
+		// dispatch queued events
+		static void dispatchPostedEvents();
+
 	public:
 		// ctor: takes ownership of a GLFW window handle
 		Window(GLFWwindow *handle_, const Window *share = nullptr) : m_handle(handle_) {
@@ -758,7 +771,26 @@ namespace gecom {
 		// main thread only (at the moment)
 		static void dispatchGlobalEvent(const window_event &);
 
-		// main thread only
+		// can be called from any thread.
+		// the event is copied and dispatched as a global event by the next pollEvents() on the main thread;
+		// events are dispatched in the order they were posted. the event is given a new uid on dispatch.
+		// if the event refers to a window, the window must not be destroyed before then.
+		template <typename EventT>
+		static void postGlobalEvent(const EventT &e) {
+			static_assert(std::is_base_of<window_event, EventT>::value, "EventT must derive from window_event");
+			static_assert(alignof(EventT) <= alignof(std::max_align_t), "EventT is over-aligned");
+			void *storage = allocPostedEvent(sizeof(EventT));
+			EventT *pe = nullptr;
+			try {
+				pe = new (storage) EventT(e);
+			} catch (...) {
+				freePostedEvent(storage);
+				throw;
+			}
+			commitPostedEvent(storage, pe);
+		}
+
+		// main thread only; also dispatches posted global events
 		static void pollEvents();
 	};
 
@@ -0,0 +1,29 @@
+#include <cstdlib>
+#include <new>
+#include <atomic>
+
+#include "HeapCount.hpp"
+
+namespace {
+
+	std::atomic<size_t> heap_allocations { 0 };
+
+}
+
+size_t heapAllocations() noexcept {
+	return heap_allocations.load();
+}
+
+void * operator new(size_t size) {
+	heap_allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void *p = std::malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+	std::free(p);
+}
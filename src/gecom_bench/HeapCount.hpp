@@ -0,0 +1,16 @@
+/*
+ * GECom Benchmark Heap Allocation Counter
+ *
+ * Replaces the global operator new and delete (in their own translation unit,
+ * so they are never inlined into callers) to count allocations.
+ */
+
+#ifndef GECOM_BENCH_HEAPCOUNT_HPP
+#define GECOM_BENCH_HEAPCOUNT_HPP
+
+#include <cstddef>
+
+// global heap allocations made so far, by any thread
+size_t heapAllocations() noexcept;
+
+#endif // GECOM_BENCH_HEAPCOUNT_HPP
@@ -0,0 +1,256 @@
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <future>
+#include <atomic>
+
+#include <gecom/Log.hpp>
+#include <gecom/Concurrent.hpp>
+
+#include "HeapCount.hpp"
+
+using namespace gecom;
+using namespace std;
+
+namespace {
+
+	using bench_clock = chrono::steady_clock;
+
+	// set when a benchmark's check fails
+	bool failed = false;
+
+	// report a result as ns per operation
+	void report(const string &name, bench_clock::duration d, size_t ops) {
+		cout << setw(40) << left << name << right << fixed << setprecision(1);
+		cout << setw(10) << chrono::duration<double, nano>(d).count() / ops << " ns/op\n";
+	}
+
+	// time fun(), which performs ops operations
+	template <typename FunT>
+	void measure(const string &name, size_t ops, FunT fun) {
+		// warm up caches and pools
+		fun();
+		auto t0 = bench_clock::now();
+		fun();
+		report(name, bench_clock::now() - t0, ops);
+	}
+
+	// global heap allocations made while running fun()
+	template <typename FunT>
+	size_t countAllocations(FunT fun) {
+		const size_t a0 = heapAllocations();
+		fun();
+		return heapAllocations() - a0;
+	}
+
+	// run fun(i) on n threads at once; returns the time from start to all finished
+	template <typename FunT>
+	bench_clock::duration runThreads(unsigned n, FunT fun) {
+		atomic<unsigned> ready { 0 };
+		atomic<bool> go { false };
+		vector<thread> threads;
+		for (unsigned i = 0; i < n; i++) {
+			threads.emplace_back([&, i] {
+				ready++;
+				while (!go) this_thread::yield();
+				fun(i);
+			});
+		}
+		while (ready < n) this_thread::yield();
+		auto t0 = bench_clock::now();
+		go = true;
+		for (auto &t : threads) t.join();
+		return bench_clock::now() - t0;
+	}
+
+	void benchPool() {
+		const size_t n = 1000000;
+		const size_t size = 96;
+		vector<void *> blocks(1000);
+
+		measure("pool: allocate/free", n, [&] {
+			for (size_t i = 0; i < n; i += blocks.size()) {
+				for (auto &p : blocks) p = async::detail::pool_allocate(size);
+				for (auto p : blocks) async::detail::pool_deallocate(p, size);
+			}
+		});
+
+		measure("heap: new/delete", n, [&] {
+			for (size_t i = 0; i < n; i += blocks.size()) {
+				for (auto &p : blocks) p = ::operator new(size);
+				for (auto p : blocks) ::operator delete(p);
+			}
+		});
+
+		// allocated on one thread, freed on another
+		for (int pooled = 1; pooled >= 0; pooled--) {
+			mpmc_ring<void *> handoff(1024);
+			auto d = runThreads(2, [&](unsigned i) {
+				for (size_t k = 0; k < n; k++) {
+					if (i == 0) {
+						void *p = pooled ? async::detail::pool_allocate(size) : ::operator new(size);
+						while (!handoff.try_push(p)) this_thread::yield();
+					} else {
+						void *p;
+						while (!handoff.try_pop(p)) this_thread::yield();
+						if (pooled) {
+							async::detail::pool_deallocate(p, size);
+						} else {
+							::operator delete(p);
+						}
+					}
+				}
+			});
+			report(pooled ? "pool: cross-thread free" : "heap: cross-thread free", d, n);
+		}
+	}
+
+	void benchInvoke() {
+		const size_t n = 200000;
+		vector<future<int>> futures;
+		futures.reserve(n);
+
+		measure("invoke: background task + get", n, [&] {
+			for (size_t i = 0; i < n; i++) {
+				futures.push_back(async::invoke(chrono::milliseconds(1), [](int x) { return x; }, int(i)));
+			}
+			for (auto &f : futures) f.get();
+			futures.clear();
+		});
+
+		// steady state: with a bounded number of tasks in flight, the pools cover every block
+		// once warm, so submission must not touch the global heap. (with all n in flight at once,
+		// how many blocks are needed depends on how far the workers lag, so the pools may still grow.)
+		const size_t window = 256;
+		auto submitWindowed = [&] {
+			for (size_t i = 0; i < n; i += window) {
+				for (size_t k = 0; k < window; k++) {
+					futures.push_back(async::invoke(chrono::milliseconds(1), [](int x) { return x; }, int(k)));
+				}
+				for (auto &f : futures) f.get();
+				futures.clear();
+			}
+		};
+		submitWindowed();
+		const size_t allocs = countAllocations(submitWindowed);
+		cout << setw(40) << left << "invoke: global heap allocations" << right << setw(10) << allocs;
+		cout << (allocs ? "  FAIL\n" : "\n");
+		if (allocs) failed = true;
+
+		// baseline without the task pool: heap-allocated packaged_task and promise state
+		measure("packaged_task + get (no scheduler)", n, [&] {
+			for (size_t i = 0; i < n; i++) {
+				auto t = make_unique<packaged_task<int(int)>>([](int x) { return x; });
+				futures.push_back(t->get_future());
+				(*t)(int(i));
+			}
+			for (auto &f : futures) f.get();
+			futures.clear();
+		});
+	}
+
+	// move n ints from producers to consumers through a queue.
+	// push(i) and pop(k) are called on the producer and consumer threads; pop takes at most k
+	// elements and returns how many it took.
+	template <typename PushFunT, typename PopFunT>
+	void queueRun(const string &name, unsigned producers, unsigned consumers, PushFunT push, PopFunT pop) {
+		const size_t n = 1000000;
+		auto d = runThreads(producers + consumers, [&](unsigned i) {
+			if (i < producers) {
+				for (size_t k = i; k < n; k += producers) push(int(k));
+			} else {
+				const unsigned c = i - producers;
+				const size_t share = n / consumers + (c < n % consumers);
+				for (size_t got = 0; got < share; ) got += pop(share - got);
+			}
+		});
+		report(name + " " + to_string(producers) + "P" + to_string(consumers) + "C", d, n);
+	}
+
+	void benchQueues() {
+		for (unsigned t : { 1u, 2u, 4u }) {
+			{
+				blocking_queue<int> q;
+				queueRun("blocking_queue", t, t, [&](int x) { q.push(x); }, [&](size_t) { q.pop(); return size_t(1); });
+			}
+			{
+				mpmc_ring<int> q(1024);
+				queueRun("mpmc_ring", t, t, [&](int x) { q.push(x); }, [&](size_t) { q.pop(); return size_t(1); });
+			}
+			{
+				// producers push one at a time; consumers take batches
+				mpmc_ring<int> q(1024);
+				queueRun("mpmc_ring pop_n(32)", t, t, [&](int x) { q.push(x); }, [&](size_t k) {
+					int buf[32];
+					return q.pop_n(buf, min<size_t>(k, 32));
+				});
+			}
+		}
+		{
+			spsc_ring<int> q(1024);
+			queueRun("spsc_ring", 1, 1, [&](int x) { q.push(x); }, [&](size_t) { q.pop(); return size_t(1); });
+		}
+		{
+			spsc_ring<int> q(1024);
+			queueRun("spsc_ring pop_n(32)", 1, 1, [&](int x) { q.push(x); }, [&](size_t k) {
+				int buf[32];
+				return q.pop_n(buf, min<size_t>(k, 32));
+			});
+		}
+	}
+
+	struct benchmark {
+		const char *name;
+		const char *desc;
+		void (*run)();
+	};
+
+	const benchmark benchmarks[] {
+		{ "pool", "task memory pool against the global heap", benchPool },
+		{ "invoke", "async::invoke throughput", benchInvoke },
+		{ "queues", "bounded rings against blocking_queue under contention", benchQueues }
+	};
+
+	void usage() {
+		cerr << "usage: gecom_bench [benchmark...]\n";
+		cerr << "run gecom micro-benchmarks (all by default)\n";
+		for (auto &b : benchmarks) {
+			cerr << "  " << setw(12) << left << b.name << b.desc << "\n";
+		}
+	}
+
+}
+
+int main(int argc, char *argv[]) {
+	// keep scheduler log messages out of the results
+	Log::stdErr()->verbosity(1);
+
+	vector<const benchmark *> selected;
+	for (int i = 1; i < argc; i++) {
+		const benchmark *found = nullptr;
+		for (auto &b : benchmarks) {
+			if (strcmp(argv[i], b.name) == 0) found = &b;
+		}
+		if (!found) {
+			usage();
+			return EXIT_FAILURE;
+		}
+		selected.push_back(found);
+	}
+	if (selected.empty()) {
+		for (auto &b : benchmarks) selected.push_back(&b);
+	}
+
+	for (auto b : selected) {
+		cout << "== " << b->name << "\n";
+		b->run();
+	}
+
+	async::concurrency(0);
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,108 @@
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include <gecom/Log.hpp>
+
+using namespace gecom;
+using namespace std;
+
+namespace {
+
+	void usage() {
+		cerr << "usage: gecom_logcat [options] file...\n";
+		cerr << "decode and print binary logs written by gecom::BinaryLogOutput\n";
+		cerr << "  -v <n>       only messages with verbosity less than n\n";
+		cerr << "  -l <level>   only messages at or above level (info, warning, error, critical)\n";
+		cerr << "  -s <text>    only messages whose source contains text\n";
+		cerr << "  -m <text>    only messages whose body contains text\n";
+	}
+
+	bool parseLevel(const string &s, loglevel &l) {
+		if (s == "info") {
+			l = loglevel::info;
+		} else if (s == "warning") {
+			l = loglevel::warning;
+		} else if (s == "error") {
+			l = loglevel::error;
+		} else if (s == "critical") {
+			l = loglevel::critical;
+		} else {
+			return false;
+		}
+		return true;
+	}
+
+}
+
+int main(int argc, char *argv[]) {
+	// keep our own log messages out of the decoded output
+	Log::stdErr()->verbosity(1);
+
+	unsigned max_verbosity = -1;
+	loglevel min_level = loglevel::info;
+	string source_filter;
+	string body_filter;
+	vector<string> files;
+
+	for (int i = 1; i < argc; i++) {
+		const string arg = argv[i];
+		if (arg.size() == 2 && arg[0] == '-' && i + 1 < argc) {
+			const string value = argv[++i];
+			switch (arg[1]) {
+			case 'v':
+				max_verbosity = unsigned(strtoul(value.c_str(), nullptr, 10));
+				continue;
+			case 'l':
+				if (!parseLevel(value, min_level)) {
+					cerr << "unknown level: " << value << endl;
+					return 1;
+				}
+				continue;
+			case 's':
+				source_filter = value;
+				continue;
+			case 'm':
+				body_filter = value;
+				continue;
+			default:
+				break;
+			}
+		}
+		if (arg.empty() || arg[0] == '-') {
+			usage();
+			return 1;
+		}
+		files.push_back(arg);
+	}
+
+	if (files.empty()) {
+		usage();
+		return 1;
+	}
+
+	int r = 0;
+	logmessage msg;
+	for (const auto &fname : files) {
+		try {
+			BinaryLogReader reader(fname);
+			while (reader.read(msg)) {
+				if (msg.verbosity >= max_verbosity) continue;
+				if (msg.level < min_level) continue;
+				if (!source_filter.empty() && msg.source.find(source_filter) == string::npos) continue;
+				if (!body_filter.empty() && msg.body.find(body_filter) == string::npos) continue;
+				cout << msg << '\n';
+			}
+		} catch (exception &e) {
+			cout.flush();
+			cerr << fname << ": " << e.what() << endl;
+			r = 1;
+		}
+	}
+
+	return r;
+}